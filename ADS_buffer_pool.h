@@ -0,0 +1,166 @@
+#ifndef ADS_BUFFER_POOL_H
+#define ADS_BUFFER_POOL_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <stdexcept>
+
+#include <unistd.h>
+
+// Fixed number of page frames cached in front of one or more files. Frames are
+// pinned while a caller works on them and are replaced with the clock algorithm
+// once unpinned; dirty frames are written back when they are evicted or flushed.
+template <size_t PageSize = 4096>
+class ADS_buffer_pool {
+public:
+    using size_type = size_t;
+    using page_no = std::uint64_t;
+    using frame_id = size_type;
+
+    struct io_stats {
+        size_type hits{0};
+        size_type misses{0};
+        size_type evictions{0};
+        size_type pageReads{0};
+        size_type pageWrites{0};
+        double missNanos{0};                                         // time spent loading/evicting on misses
+
+        double hit_rate() const {
+            return hits + misses ? static_cast<double>(hits) / (hits + misses) : 0;
+        }
+    };
+private:
+    struct Frame {
+        int file{-1};
+        page_no page{0};
+        unsigned pins{0};
+        bool dirty{false};
+        bool referenced{false};
+    };
+
+    size_type capacity;
+    std::unique_ptr<unsigned char[]> data;
+    std::vector<Frame> frames;
+    std::unordered_map<std::uint64_t, frame_id> resident;
+    size_type used;
+    size_type hand;
+    io_stats io;
+public:
+    explicit ADS_buffer_pool(size_type capacity): capacity{capacity}, data{new unsigned char[capacity * PageSize]}, frames(capacity), used{0}, hand{0} {
+        if (capacity == 0) throw std::invalid_argument{"ADS_buffer_pool: capacity must be at least one page"};
+    }
+
+    ADS_buffer_pool(const ADS_buffer_pool &) = delete;
+    ADS_buffer_pool &operator=(const ADS_buffer_pool &) = delete;
+
+    ~ADS_buffer_pool() {
+        try {
+            flush();
+        } catch (...) {}
+    }
+
+    // Pins page p of file and returns its frame. With load == false the caller
+    // promises to overwrite the whole page, so a missing page is not read first.
+    frame_id pin(int file, page_no p, bool load = true) {
+        auto it = resident.find(tag(file, p));
+        if (it != resident.end()) {
+            io.hits++;
+            Frame &f = frames[it->second];
+            f.pins++;
+            f.referenced = true;
+            return it->second;
+        }
+
+        io.misses++;
+        auto start = std::chrono::steady_clock::now();
+        frame_id id = victim();
+        Frame &f = frames[id];
+        if (load) {
+            io.pageReads++;
+            ssize_t n = ::pread(file, page(id), PageSize, static_cast<off_t>(p * PageSize));
+            if (n < 0) fail("pread");
+            std::memset(page(id) + n, 0, PageSize - static_cast<size_type>(n));
+        }
+        f.file = file;
+        f.page = p;
+        f.pins = 1;
+        f.dirty = false;
+        f.referenced = true;
+        resident[tag(file, p)] = id;
+        io.missNanos += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        return id;
+    }
+
+    void unpin(frame_id id, bool dirty) {
+        frames[id].pins--;
+        frames[id].dirty |= dirty;
+    }
+
+    unsigned char *page(frame_id id) {
+        return data.get() + id * PageSize;
+    }
+
+    void flush() {
+        for (frame_id id{0}; id < used; id++) {
+            if (frames[id].dirty) writeBack(id);
+        }
+    }
+
+    size_type size() const {
+        return capacity;
+    }
+
+    const io_stats &io_counters() const {
+        return io;
+    }
+
+    void reset_io_counters() {
+        io = io_stats{};
+    }
+
+private:
+    static std::uint64_t tag(int file, page_no p) {
+        return (static_cast<std::uint64_t>(file) << 48) ^ p;
+    }
+
+    frame_id victim() {
+        if (used < capacity) return used++;
+
+        // every frame gets two sweeps: the first clears its reference bit
+        for (size_type sweep{0}; sweep < 2 * capacity; sweep++) {
+            frame_id id = hand;
+            hand = (hand + 1) % capacity;
+            Frame &f = frames[id];
+            if (f.pins) continue;
+            if (f.referenced) {
+                f.referenced = false;
+                continue;
+            }
+
+            io.evictions++;
+            if (f.dirty) writeBack(id);
+            resident.erase(tag(f.file, f.page));
+            return id;
+        }
+        throw std::runtime_error{"ADS_buffer_pool: all frames are pinned"};
+    }
+
+    void writeBack(frame_id id) {
+        Frame &f = frames[id];
+        io.pageWrites++;
+        if (::pwrite(f.file, page(id), PageSize, static_cast<off_t>(f.page * PageSize)) != static_cast<ssize_t>(PageSize)) fail("pwrite");
+        f.dirty = false;
+    }
+
+    [[noreturn]] static void fail(const std::string &what) {
+        throw std::runtime_error{"ADS_buffer_pool: " + what + ": " + std::strerror(errno)};
+    }
+};
+
+#endif // ADS_BUFFER_POOL_H
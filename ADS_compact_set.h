@@ -0,0 +1,359 @@
+#ifndef ADS_COMPACT_SET_H
+#define ADS_COMPACT_SET_H
+
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "ADS_set.h"
+
+// Variant of ADS_set for small keys whose buckets are addressed by 32-bit handles
+// instead of pointers. All buckets live in one pool; directory entries and overflow
+// links are indexes into it (0 = no bucket) and released buckets go on a free list.
+// This halves the link overhead per bucket and per directory slot, and makes the
+// table relocatable: serialize() writes the directory and the pool as they are.
+template <typename Key, size_t N = 7, typename Mixer = ads::default_mixer<Key>>
+class ADS_compact_set {
+public:
+    using value_type = Key;
+    using key_type = Key;
+    using size_type = size_t;
+    using key_equal = std::equal_to<key_type>;
+    using hasher = std::hash<key_type>;
+private:
+    using handle = std::uint32_t;
+
+    struct Bucket {
+        std::uint32_t bucketSize{0};
+        handle nextBucket{0};
+        key_type entries[N]{};
+    };
+
+    struct SerialHeader {
+        std::uint64_t magic;
+        std::uint64_t keySize;
+        std::uint64_t bucketCapacity;
+        std::uint64_t numOfElements;
+        std::uint64_t roundNumber;
+        std::uint64_t nextToSplit;
+        std::uint64_t hashSeed;
+        std::uint64_t freeList;
+        std::uint64_t directorySize;
+        std::uint64_t poolSize;
+        std::uint64_t mixerTag;                                      // as in ADS_set: Mixer::mix of the magic under the seed
+    };
+    static constexpr std::uint64_t serialMagic = 0x4144535f43535432; // "ADS_CST2"
+
+    size_type numOfElements;
+    size_type roundNumber;
+    size_type nextToSplit;
+    size_type hashSeed;
+    handle freeList;
+    std::vector<handle> directory;
+    std::vector<Bucket> pool;                                        // pool[0] is never used
+public:
+    ADS_compact_set(): numOfElements{0}, roundNumber{1}, nextToSplit{0}, hashSeed{ads::process_seed()}, freeList{0}, directory(2), pool(1) {}
+
+    ADS_compact_set(std::initializer_list<key_type> ilist): ADS_compact_set{} {
+        for (const key_type& key : ilist) insert(key);
+    }
+
+    size_type size() const {
+        return numOfElements;
+    }
+
+    bool empty() const {
+        return numOfElements == 0;
+    }
+
+    size_type bucket_count() const {
+        return directory.size();
+    }
+
+    // Directory, bucket pool (including free buckets) and the set itself, without the
+    // vectors' spare capacity.
+    size_type memory_bytes() const {
+        return sizeof(ADS_compact_set) + directory.size() * sizeof(handle) + pool.size() * sizeof(Bucket);
+    }
+
+    bool insert(const key_type& key) {
+        size_type index = getIndex(key);
+        for (handle h{directory[index]}; h; h = pool[h].nextBucket) {
+            const Bucket& b = pool[h];
+            for (size_type i{0}; i < b.bucketSize; i++) {
+                if (key_equal{}(b.entries[i], key)) return false;
+            }
+        }
+
+        numOfElements++;
+        if (append(directory[index], key)) split();
+        return true;
+    }
+
+    size_type count(const key_type& key) const {
+        for (handle h{directory[getIndex(key)]}; h; h = pool[h].nextBucket) {
+            const Bucket& b = pool[h];
+            for (size_type i{0}; i < b.bucketSize; i++) {
+                if (key_equal{}(b.entries[i], key)) return 1;
+            }
+        }
+        return 0;
+    }
+
+    size_type erase(const key_type& key) {
+        size_type index = getIndex(key);
+        handle prev{0};
+        for (handle h{directory[index]}; h; prev = h, h = pool[h].nextBucket) {
+            Bucket& b = pool[h];
+            for (size_type i{0}; i < b.bucketSize; i++) {
+                if (!key_equal{}(b.entries[i], key)) continue;
+                std::move(b.entries + i + 1, b.entries + b.bucketSize, b.entries + i);
+                b.bucketSize--;
+                numOfElements--;
+                if (b.bucketSize == 0) {
+                    if (prev) pool[prev].nextBucket = b.nextBucket;
+                    else directory[index] = b.nextBucket;
+                    releaseBucket(h);
+                }
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    void clear() {
+        ADS_compact_set empty;
+        empty.hashSeed = hashSeed;
+        swap(empty);
+    }
+
+    void swap(ADS_compact_set &other) {
+        std::swap(numOfElements, other.numOfElements);
+        std::swap(roundNumber, other.roundNumber);
+        std::swap(nextToSplit, other.nextToSplit);
+        std::swap(hashSeed, other.hashSeed);
+        std::swap(freeList, other.freeList);
+        directory.swap(other.directory);
+        pool.swap(other.pool);
+    }
+
+    template <typename F>
+    void for_each(F f) const {
+        for (handle head : directory) {
+            for (handle h{head}; h; h = pool[h].nextBucket) {
+                const Bucket& b = pool[h];
+                for (size_type i{0}; i < b.bucketSize; i++) f(static_cast<const key_type&>(b.entries[i]));
+            }
+        }
+    }
+
+    friend bool operator==(const ADS_compact_set &lhs, const ADS_compact_set &rhs) {
+        if (lhs.numOfElements != rhs.numOfElements) return false;
+        bool equal{true};
+        lhs.for_each([&](const key_type& key) { equal = equal && rhs.count(key); });
+        return equal;
+    }
+
+    friend bool operator!=(const ADS_compact_set &lhs, const ADS_compact_set &rhs) {
+        return !(lhs == rhs);
+    }
+
+    // Writes the table as it is in memory; only for trivially copyable keys, and
+    // readable on machines with the same byte order.
+    void serialize(std::ostream &o) const {
+        static_assert(std::is_trivially_copyable<key_type>::value, "ADS_compact_set serializes keys as raw bytes");
+        SerialHeader header{serialMagic, sizeof(key_type), N, numOfElements, roundNumber, nextToSplit, hashSeed, freeList, directory.size(), pool.size(), mixerTag(hashSeed)};
+        o.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        o.write(reinterpret_cast<const char *>(directory.data()), static_cast<std::streamsize>(directory.size() * sizeof(handle)));
+        o.write(reinterpret_cast<const char *>(pool.data()), static_cast<std::streamsize>(pool.size() * sizeof(Bucket)));
+    }
+
+    void deserialize(std::istream &i) {
+        static_assert(std::is_trivially_copyable<key_type>::value, "ADS_compact_set serializes keys as raw bytes");
+        SerialHeader header;
+        read(i, &header, sizeof(header));
+        if (header.magic != serialMagic || header.keySize != sizeof(key_type) || header.bucketCapacity != N || header.roundNumber == 0 || header.roundNumber >= 32
+            || header.nextToSplit >= (std::uint64_t{1} << header.roundNumber) || header.directorySize != (std::uint64_t{1} << header.roundNumber) + header.nextToSplit
+            || header.poolSize == 0 || header.poolSize > std::uint64_t{std::numeric_limits<handle>::max()} + 1 || header.freeList >= header.poolSize)
+            throw std::runtime_error{"ADS_compact_set::deserialize: input was not written by ADS_compact_set::serialize for this key type"};
+        if (header.mixerTag != mixerTag(static_cast<size_type>(header.hashSeed)))
+            throw std::runtime_error{"ADS_compact_set::deserialize: input was written by an ADS_compact_set with another mixer"};
+
+        ADS_compact_set temp;
+        temp.numOfElements = static_cast<size_type>(header.numOfElements);
+        temp.roundNumber = static_cast<size_type>(header.roundNumber);
+        temp.nextToSplit = static_cast<size_type>(header.nextToSplit);
+        temp.hashSeed = static_cast<size_type>(header.hashSeed);
+        temp.freeList = static_cast<handle>(header.freeList);
+        readAll(i, temp.directory, static_cast<size_type>(header.directorySize));
+        readAll(i, temp.pool, static_cast<size_type>(header.poolSize));
+
+        // handles are followed without checks later on, so every bucket has to be in
+        // exactly one chain or on the free list, and the chains have to hold numOfElements keys
+        for (handle h : temp.directory) {
+            if (h >= temp.pool.size()) throw std::runtime_error{"ADS_compact_set::deserialize: bucket handle out of range"};
+        }
+        for (const Bucket& b : temp.pool) {
+            if (b.nextBucket >= temp.pool.size() || b.bucketSize > N) throw std::runtime_error{"ADS_compact_set::deserialize: corrupt bucket"};
+        }
+
+        std::vector<bool> seen(temp.pool.size());
+        seen[0] = true;
+        size_type total{0};
+        for (handle head : temp.directory) {
+            for (handle h{head}; h; h = temp.pool[h].nextBucket) {
+                if (seen[h]) throw std::runtime_error{"ADS_compact_set::deserialize: bucket linked twice"};
+                seen[h] = true;
+                total += temp.pool[h].bucketSize;
+            }
+        }
+        for (handle h{temp.freeList}; h; h = temp.pool[h].nextBucket) {
+            if (seen[h] || temp.pool[h].bucketSize != 0) throw std::runtime_error{"ADS_compact_set::deserialize: corrupt free list"};
+            seen[h] = true;
+        }
+        if (total != temp.numOfElements) throw std::runtime_error{"ADS_compact_set::deserialize: element count does not match the bucket contents"};
+        if (std::find(seen.begin(), seen.end(), false) != seen.end()) throw std::runtime_error{"ADS_compact_set::deserialize: bucket in no chain"};
+
+        // a sample of the keys has to hash to where it was written, which catches
+        // tables written with another hasher
+        for (size_type i{0}; i < temp.directory.size(); i += 64) {
+            handle h = temp.directory[i];
+            if (h && temp.pool[h].bucketSize && temp.getIndex(temp.pool[h].entries[0]) != i)
+                throw std::runtime_error{"ADS_compact_set::deserialize: keys are not where this set's hash places them"};
+        }
+        swap(temp);
+    }
+
+private:
+    static size_type mixerTag(size_type seed) {
+        return Mixer::mix(static_cast<size_type>(serialMagic), seed);
+    }
+
+    size_type getIndex(const key_type& key) const {
+        size_type h = Mixer::mix(hasher{}(key), hashSeed);
+        size_type index = h & ((size_type{1} << roundNumber) - 1);
+        if (index < nextToSplit) index = h & ((size_type{1} << (roundNumber + 1)) - 1);
+        return index;
+    }
+
+    // Allocating may move the pool, so callers hold handles, not Bucket references.
+    handle allocateBucket() {
+        if (freeList) {
+            handle h = freeList;
+            freeList = pool[h].nextBucket;
+            pool[h].nextBucket = 0;
+            return h;
+        }
+        if (pool.size() > std::numeric_limits<handle>::max()) throw std::length_error{"ADS_compact_set: more than 2^32 - 1 buckets"};
+        pool.emplace_back();
+        return static_cast<handle>(pool.size() - 1);
+    }
+
+    void releaseBucket(handle h) {
+        pool[h].bucketSize = 0;
+        pool[h].nextBucket = freeList;
+        freeList = h;
+    }
+
+    // Appends key to the chain starting at head, which stays 0 until a key lands there;
+    // returns true if that took a new overflow bucket, which is when the table splits.
+    bool append(handle& head, const key_type& key) {
+        if (!head) {
+            handle h = allocateBucket();
+            head = h;
+            pool[h].entries[pool[h].bucketSize++] = key;
+            return false;
+        }
+
+        handle h{head};
+        while (pool[h].bucketSize == N) {
+            if (!pool[h].nextBucket) {
+                handle next = allocateBucket();
+                pool[h].nextBucket = next;
+                pool[next].entries[pool[next].bucketSize++] = key;
+                return true;
+            }
+            h = pool[h].nextBucket;
+        }
+        pool[h].entries[pool[h].bucketSize++] = key;
+        return false;
+    }
+
+    void split() {
+        size_type index = nextToSplit++;
+        directory.push_back(0);
+        partition(index, directory.size() - 1);
+
+        if (nextToSplit == size_type{1} << roundNumber) {
+            roundNumber++;
+            nextToSplit = 0;
+        }
+    }
+
+    // As ADS_set::partition: keys that stay are compacted to the front of the chain,
+    // the others are appended to chain `to`, emptied buckets are released.
+    void partition(size_type from, size_type to) {
+        handle out{directory[from]};
+        size_type kept{0};
+        for (handle b{directory[from]}; b; b = pool[b].nextBucket) {
+            size_type n{pool[b].bucketSize};
+            for (size_type i{0}; i < n; i++) {
+                if (getIndex(pool[b].entries[i]) != from) {
+                    key_type key = std::move(pool[b].entries[i]);    // the pool may move while appending
+                    append(directory[to], key);
+                    continue;
+                }
+                if (kept == N) {
+                    pool[out].bucketSize = N;
+                    out = pool[out].nextBucket;
+                    kept = 0;
+                }
+                if (out != b || kept != i) pool[out].entries[kept] = std::move(pool[b].entries[i]);
+                kept++;
+            }
+        }
+        if (!out) return;
+
+        handle rest = pool[out].nextBucket;
+        pool[out].nextBucket = 0;
+        pool[out].bucketSize = static_cast<std::uint32_t>(kept);
+        while (rest) {
+            handle next = pool[rest].nextBucket;
+            releaseBucket(rest);
+            rest = next;
+        }
+        if (kept == 0) {
+            releaseBucket(directory[from]);
+            directory[from] = 0;
+        }
+    }
+
+    // Reads n elements into v, growing it only as the input delivers them, so that a
+    // corrupt header cannot make it allocate more than the input holds.
+    template <typename T>
+    static void readAll(std::istream &i, std::vector<T> &v, size_type n) {
+        constexpr size_type chunk = 4096;
+        v.clear();
+        while (v.size() < n) {
+            size_type done = v.size();
+            v.resize(std::min(n, done + chunk));
+            read(i, v.data() + done, (v.size() - done) * sizeof(T));
+        }
+    }
+
+    static void read(std::istream &i, void *p, size_type n) {
+        if (!i.read(static_cast<char *>(p), static_cast<std::streamsize>(n))) throw std::runtime_error{"ADS_compact_set::deserialize: unexpected end of input"};
+    }
+};
+
+template <typename Key, size_t N, typename Mixer>
+void swap(ADS_compact_set<Key,N,Mixer> &lhs, ADS_compact_set<Key,N,Mixer> &rhs) { lhs.swap(rhs); }
+
+#endif // ADS_COMPACT_SET_H
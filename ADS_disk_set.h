@@ -0,0 +1,379 @@
+#ifndef ADS_DISK_SET_H
+#define ADS_DISK_SET_H
+
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "ADS_buffer_pool.h"
+
+// Disk-resident variant of ADS_set. Every bucket is one page of a file: primary
+// bucket i lives at page i+1 of <path> (page 0 holds the table geometry), overflow
+// pages live in <path>.ovf and are chained through their page numbers. Because
+// primary pages are addressed by bucket number, no directory is kept in memory.
+// All page accesses go through an ADS_buffer_pool; give it at least bucket_count()
+// frames to keep the primary pages resident.
+template <typename Key, size_t PageSize = 4096>
+class ADS_disk_set {
+    static_assert(std::is_trivially_copyable<Key>::value, "ADS_disk_set stores keys as raw bytes");
+public:
+    using value_type = Key;
+    using key_type = Key;
+    using size_type = size_t;
+    using key_equal = std::equal_to<key_type>;
+    using hasher = std::hash<key_type>;
+    using buffer_pool = ADS_buffer_pool<PageSize>;
+    using io_stats = typename buffer_pool::io_stats;
+private:
+    using page_no = std::uint64_t;
+
+    struct PageHeader {
+        std::uint32_t bucketSize;
+        std::uint32_t unused;
+        page_no nextPage;                                            // 0 = end of chain
+    };
+public:
+    static constexpr size_type N = (PageSize - sizeof(PageHeader)) / sizeof(Key);
+    static_assert(N > 0, "page too small for a single key");
+private:
+    struct Page {
+        PageHeader header;
+        key_type entries[N];
+    };
+
+    struct Meta {
+        std::uint64_t magic;
+        std::uint64_t pageSize;
+        std::uint64_t keySize;
+        std::uint64_t numOfElements;
+        std::uint64_t roundNumber;
+        std::uint64_t nextToSplit;
+        std::uint64_t overflowPages;                                 // pages handed out in <path>.ovf
+        page_no freeList;                                            // released overflow pages
+    };
+    static_assert(sizeof(Meta) <= PageSize, "page too small for table geometry");
+    static constexpr std::uint64_t magicNumber = 0x4144535f4c484453; // "ADS_LHDS"
+
+    int primaryFile;
+    int overflowFile;
+    size_type numOfElements;
+    size_type roundNumber;
+    size_type nextToSplit;
+    size_type overflowPages;
+    page_no freeList;
+    mutable buffer_pool pool;
+public:
+    explicit ADS_disk_set(const std::string &path, size_type poolPages = 1024): primaryFile{-1}, overflowFile{-1}, pool{poolPages} {
+        primaryFile = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (primaryFile < 0) fail("open " + path);
+        overflowFile = ::open((path + ".ovf").c_str(), O_RDWR | O_CREAT, 0644);
+        if (overflowFile < 0) {
+            ::close(primaryFile);
+            fail("open " + path + ".ovf");
+        }
+
+        // the destructor does not run for a constructor that throws
+        try {
+            if (::lseek(primaryFile, 0, SEEK_END) == 0) {
+                numOfElements = 0;
+                roundNumber = 1;
+                nextToSplit = 0;
+                overflowPages = 1;                                   // page 0 is never used so 0 can mean "none"
+                freeList = 0;
+                Page empty{};
+                writePrimary(0, empty);
+                writePrimary(1, empty);
+                writeMeta();
+            } else {
+                readMeta();
+            }
+        } catch (...) {
+            ::close(primaryFile);
+            ::close(overflowFile);
+            throw;
+        }
+    }
+
+    ADS_disk_set(const ADS_disk_set &) = delete;
+    ADS_disk_set &operator=(const ADS_disk_set &) = delete;
+
+    ~ADS_disk_set() {
+        try {
+            writeMeta();
+            pool.flush();
+        } catch (...) {}
+        ::close(primaryFile);
+        ::close(overflowFile);
+    }
+
+    size_type size() const {
+        return numOfElements;
+    }
+
+    bool empty() const {
+        return numOfElements == 0;
+    }
+
+    size_type bucket_count() const {
+        return (size_type{1} << roundNumber) + nextToSplit;
+    }
+
+    const io_stats &io_counters() const {
+        return pool.io_counters();
+    }
+
+    void reset_io_counters() {
+        pool.reset_io_counters();
+    }
+
+    void flush() {
+        writeMeta();
+        pool.flush();
+        if (::fsync(primaryFile) != 0 || ::fsync(overflowFile) != 0) fail("fsync");
+    }
+
+    bool insert(const key_type &key) {
+        size_type index = getIndex(key);
+        Page page;
+        readPrimary(index, page);
+
+        page_no pageNo{0};
+        while (true) {
+            for (std::uint32_t i = 0; i < page.header.bucketSize; ++i) {
+                if (key_equal{}(page.entries[i], key)) return false;
+            }
+            if (page.header.nextPage == 0) break;
+            pageNo = page.header.nextPage;
+            readOverflow(pageNo, page);
+        }
+
+        numOfElements++;
+        if (page.header.bucketSize < N) {
+            page.entries[page.header.bucketSize++] = key;
+            writeBucketPage(index, pageNo, page);
+            return true;
+        }
+
+        Page overflow{};
+        overflow.entries[overflow.header.bucketSize++] = key;
+        page.header.nextPage = allocateOverflow();
+        writeOverflow(page.header.nextPage, overflow);
+        writeBucketPage(index, pageNo, page);
+        split();
+        return true;
+    }
+
+    size_type count(const key_type &key) const {
+        Page page;
+        readPrimary(getIndex(key), page);
+        while (true) {
+            for (std::uint32_t i = 0; i < page.header.bucketSize; ++i) {
+                if (key_equal{}(page.entries[i], key)) return 1;
+            }
+            if (page.header.nextPage == 0) return 0;
+            readOverflow(page.header.nextPage, page);
+        }
+    }
+
+    size_type erase(const key_type &key) {
+        size_type index = getIndex(key);
+        Page page;
+        readPrimary(index, page);
+
+        Page prev;
+        page_no prevNo{0};
+        page_no pageNo{0};
+        while (true) {
+            for (std::uint32_t i = 0; i < page.header.bucketSize; ++i) {
+                if (!key_equal{}(page.entries[i], key)) continue;
+
+                page.entries[i] = page.entries[--page.header.bucketSize];
+                numOfElements--;
+
+                if (page.header.bucketSize > 0 || (page.header.nextPage == 0 && pageNo == 0)) {
+                    writeBucketPage(index, pageNo, page);
+                } else if (pageNo == 0) {
+                    // the primary page cannot move, so the first overflow page takes its place
+                    page_no next = page.header.nextPage;
+                    readOverflow(next, page);
+                    writePrimary(index, page);
+                    releaseOverflow(next);
+                } else {
+                    prev.header.nextPage = page.header.nextPage;
+                    writeBucketPage(index, prevNo, prev);
+                    releaseOverflow(pageNo);
+                }
+                return 1;
+            }
+            if (page.header.nextPage == 0) return 0;
+            prev = page;
+            prevNo = pageNo;
+            pageNo = page.header.nextPage;
+            readOverflow(pageNo, page);
+        }
+    }
+
+    template <typename F>
+    void for_each(F f) const {
+        Page page;
+        for (size_type i{0}; i < bucket_count(); i++) {
+            readPrimary(i, page);
+            while (true) {
+                for (std::uint32_t j = 0; j < page.header.bucketSize; ++j) f(page.entries[j]);
+                if (page.header.nextPage == 0) break;
+                readOverflow(page.header.nextPage, page);
+            }
+        }
+    }
+
+    size_type getIndex(const key_type &key) const {
+        size_type hashedKey = hasher{}(key);
+        size_type index = hashedKey & ((size_type{1} << roundNumber) - 1);
+        if (index < nextToSplit) index = hashedKey & ((size_type{1} << (roundNumber+1)) - 1);
+        return index;
+    }
+
+private:
+    // Reads the chain of bucket nextToSplit once, then writes the two primary pages
+    // and as many overflow pages as the two halves need, reusing the old chain's pages.
+    void split() {
+        size_type oldIndex = nextToSplit;
+        size_type newIndex = bucket_count();
+
+        std::vector<key_type> keys;
+        std::vector<page_no> chain;
+        Page page;
+        readPrimary(oldIndex, page);
+        while (true) {
+            keys.insert(keys.end(), page.entries, page.entries + page.header.bucketSize);
+            if (page.header.nextPage == 0) break;
+            chain.push_back(page.header.nextPage);
+            readOverflow(page.header.nextPage, page);
+        }
+
+        nextToSplit++;
+        auto movers = std::partition(keys.begin(), keys.end(), [this, oldIndex](const key_type &k) {
+            return getIndex(k) == oldIndex;
+        });
+
+        std::reverse(chain.begin(), chain.end());
+        writeChain(oldIndex, keys.begin(), movers, chain);
+        writeChain(newIndex, movers, keys.end(), chain);
+        for (page_no p : chain) releaseOverflow(p);
+
+        if (nextToSplit == (size_type{1} << roundNumber)) {
+            roundNumber++;
+            nextToSplit = 0;
+        }
+        writeMeta();
+    }
+
+    template <typename It>
+    void writeChain(size_type index, It first, It last, std::vector<page_no> &spare) {
+        Page page{};
+        page_no pageNo{0};
+        while (true) {
+            size_type n = std::min<size_type>(N, static_cast<size_type>(last - first));
+            page.header.bucketSize = static_cast<std::uint32_t>(n);
+            std::copy(first, first + n, page.entries);
+            first += n;
+
+            page.header.nextPage = 0;
+            if (first != last) {
+                if (spare.empty()) {
+                    page.header.nextPage = allocateOverflow();
+                } else {
+                    page.header.nextPage = spare.back();
+                    spare.pop_back();
+                }
+            }
+            writeBucketPage(index, pageNo, page);
+            if (first == last) return;
+            pageNo = page.header.nextPage;
+        }
+    }
+
+    page_no allocateOverflow() {
+        if (freeList == 0) return overflowPages++;
+        page_no p = freeList;
+        Page page;
+        readOverflow(p, page);
+        freeList = page.header.nextPage;
+        return p;
+    }
+
+    void releaseOverflow(page_no p) {
+        Page page{};
+        page.header.nextPage = freeList;
+        writeOverflow(p, page);
+        freeList = p;
+    }
+
+    void writeBucketPage(size_type index, page_no pageNo, const Page &page) {
+        if (pageNo == 0) writePrimary(index, page);
+        else writeOverflow(pageNo, page);
+    }
+
+    void readPrimary(size_type index, Page &page) const {
+        readPage(primaryFile, index + 1, &page, sizeof(Page));
+    }
+
+    void writePrimary(size_type index, const Page &page) {
+        writePage(primaryFile, index + 1, &page, sizeof(Page));
+    }
+
+    void readOverflow(page_no p, Page &page) const {
+        readPage(overflowFile, p, &page, sizeof(Page));
+    }
+
+    void writeOverflow(page_no p, const Page &page) {
+        writePage(overflowFile, p, &page, sizeof(Page));
+    }
+
+    void readMeta() {
+        Meta meta;
+        readPage(primaryFile, 0, &meta, sizeof(Meta));
+        if (meta.magic != magicNumber || meta.pageSize != PageSize || meta.keySize != sizeof(Key))
+            throw std::runtime_error{"ADS_disk_set: file was written with a different layout"};
+        numOfElements = meta.numOfElements;
+        roundNumber = meta.roundNumber;
+        nextToSplit = meta.nextToSplit;
+        overflowPages = meta.overflowPages;
+        freeList = meta.freeList;
+    }
+
+    void writeMeta() {
+        Meta meta{magicNumber, PageSize, sizeof(Key), numOfElements, roundNumber, nextToSplit, overflowPages, freeList};
+        writePage(primaryFile, 0, &meta, sizeof(Meta));
+    }
+
+    void readPage(int fd, page_no p, void *buf, size_type len) const {
+        auto frame = pool.pin(fd, p);
+        std::memcpy(buf, pool.page(frame), len);
+        pool.unpin(frame, false);
+    }
+
+    // buf is all the page holds: a page missing from the pool is not read first, and
+    // the bytes past len are zeroed.
+    void writePage(int fd, page_no p, const void *buf, size_type len) {
+        auto frame = pool.pin(fd, p, false);
+        std::memcpy(pool.page(frame), buf, len);
+        std::memset(pool.page(frame) + len, 0, PageSize - len);
+        pool.unpin(frame, true);
+    }
+
+    [[noreturn]] static void fail(const std::string &what) {
+        throw std::runtime_error{"ADS_disk_set: " + what + ": " + std::strerror(errno)};
+    }
+};
+
+#endif // ADS_DISK_SET_H
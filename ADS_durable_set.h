@@ -0,0 +1,258 @@
+#ifndef ADS_DURABLE_SET_H
+#define ADS_DURABLE_SET_H
+
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "ADS_set.h"
+
+// ADS_set whose inserts and erases survive a crash. Every change is appended to the
+// write-ahead log <path>.log; records are collected and written with one fdatasync
+// per groupCommit records (or on sync()), so an operation is durable once its group
+// has been committed. Every checkpointInterval records a snapshot of the whole set
+// is written to <path>.ckpt with ADS_set::serialize() and the log is truncated. Opening an existing path loads
+// the last checkpoint and replays the log tail behind it.
+//
+// Replaying log records that are already contained in the checkpoint is harmless:
+// the state of a key only depends on the last insert/erase logged for it. This makes
+// a crash between writing the checkpoint and truncating the log safe.
+template <typename Key, size_t N = 7>
+class ADS_durable_set {
+    static_assert(std::is_trivially_copyable<Key>::value, "ADS_durable_set logs keys as raw bytes");
+public:
+    using set_type = ADS_set<Key, N>;
+    using value_type = Key;
+    using key_type = Key;
+    using size_type = size_t;
+    using const_iterator = typename set_type::const_iterator;
+    using iterator = const_iterator;
+
+    struct log_stats {
+        size_type records{0};
+        size_type commits{0};
+        size_type checkpoints{0};
+        size_type replayed{0};                                       // records applied during recovery
+    };
+private:
+    enum Op : std::uint32_t { opInsert = 1, opErase = 2 };
+
+    struct Record {
+        std::uint32_t op;
+        std::uint32_t checksum;
+        key_type key;
+    };
+
+    std::string path;
+    set_type elements;
+    int logFile;
+    std::vector<char> pending;
+    size_type pendingRecords;
+    size_type groupCommit;
+    size_type checkpointInterval;
+    size_type sinceCheckpoint;
+    log_stats stats;
+public:
+    explicit ADS_durable_set(const std::string &path, size_type groupCommit = 64, size_type checkpointInterval = 1u << 20):
+        path{path}, logFile{-1}, pendingRecords{0}, groupCommit{groupCommit ? groupCommit : 1},
+        checkpointInterval{checkpointInterval}, sinceCheckpoint{0} {
+        recover();
+    }
+
+    ADS_durable_set(const ADS_durable_set &) = delete;
+    ADS_durable_set &operator=(const ADS_durable_set &) = delete;
+
+    ~ADS_durable_set() {
+        try {
+            sync();
+        } catch (...) {}
+        ::close(logFile);
+    }
+
+    size_type size() const {
+        return elements.size();
+    }
+
+    bool empty() const {
+        return elements.empty();
+    }
+
+    size_type count(const key_type &key) const {
+        return elements.count(key);
+    }
+
+    const set_type &set() const {
+        return elements;
+    }
+
+    const_iterator begin() const {
+        return elements.begin();
+    }
+
+    const_iterator end() const {
+        return elements.end();
+    }
+
+    const log_stats &log_counters() const {
+        return stats;
+    }
+
+    bool insert(const key_type &key) {
+        if (!elements.insert(key).second) return false;
+        append(opInsert, key);
+        return true;
+    }
+
+    size_type erase(const key_type &key) {
+        if (!elements.erase(key)) return 0;
+        append(opErase, key);
+        return 1;
+    }
+
+    // Commits all pending records with a single write and fdatasync.
+    void sync() {
+        if (pending.empty()) return;
+        writeAll(logFile, pending.data(), pending.size());
+        if (::fdatasync(logFile) != 0) fail("fdatasync " + path + ".log");
+        pending.clear();
+        pendingRecords = 0;
+        stats.commits++;
+    }
+
+    // Writes a snapshot of the set next to the log and starts a new, empty log.
+    void checkpoint() {
+        sync();
+        std::string tmp = path + ".ckpt.tmp";
+        int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) fail("open " + tmp);
+
+        std::vector<char> buf;
+        elements.serialize(buf);
+        writeAll(fd, buf.data(), buf.size());
+        if (::fsync(fd) != 0) fail("fsync " + tmp);
+        ::close(fd);
+
+        if (std::rename(tmp.c_str(), (path + ".ckpt").c_str()) != 0) fail("rename " + tmp);
+        // the rename has to be durable before the log it replaces is gone
+        syncDirectory();
+        if (::ftruncate(logFile, 0) != 0 || ::lseek(logFile, 0, SEEK_SET) != 0) fail("truncate " + path + ".log");
+        if (::fdatasync(logFile) != 0) fail("fdatasync " + path + ".log");
+        sinceCheckpoint = 0;
+        stats.checkpoints++;
+    }
+
+private:
+    void append(Op op, const key_type &key) {
+        Record r;
+        std::memset(&r, 0, sizeof(r));
+        r.op = op;
+        std::memcpy(&r.key, &key, sizeof(Key));
+        r.checksum = checksum(r);
+
+        const char *bytes = reinterpret_cast<const char *>(&r);
+        pending.insert(pending.end(), bytes, bytes + sizeof(Record));
+        stats.records++;
+        if (++pendingRecords >= groupCommit) sync();
+        if (checkpointInterval && ++sinceCheckpoint >= checkpointInterval) checkpoint();
+    }
+
+    void recover() {
+        loadCheckpoint();
+
+        std::string log = path + ".log";
+        logFile = ::open(log.c_str(), O_RDWR | O_CREAT, 0644);
+        if (logFile < 0) fail("open " + log);
+        // a log just created only survives a crash with its directory entry, and the
+        // records committed to it before the first checkpoint with it
+        try {
+            syncDirectory();
+        } catch (...) {
+            ::close(logFile);
+            throw;
+        }
+
+        Record r;
+        off_t valid = 0;
+        while (::pread(logFile, &r, sizeof(Record), valid) == static_cast<ssize_t>(sizeof(Record)) && r.checksum == checksum(r)) {
+            if (r.op == opInsert) elements.insert(r.key);
+            else if (r.op == opErase) elements.erase(r.key);
+            else break;
+            valid += sizeof(Record);
+            stats.replayed++;
+        }
+
+        // drop a torn record left behind by a crash in the middle of a commit
+        if (::ftruncate(logFile, valid) != 0 || ::lseek(logFile, valid, SEEK_SET) != valid) fail("truncate " + log);
+        sinceCheckpoint = stats.replayed;
+    }
+
+    void loadCheckpoint() {
+        std::string ckpt = path + ".ckpt";
+        int fd = ::open(ckpt.c_str(), O_RDONLY);
+        if (fd < 0) {
+            if (errno == ENOENT) return;
+            fail("open " + ckpt);
+        }
+
+        std::vector<char> buf;
+        char chunk[1 << 16];
+        for (ssize_t n; (n = ::read(fd, chunk, sizeof(chunk))) != 0; ) {
+            if (n < 0) {
+                ::close(fd);
+                fail("read " + ckpt);
+            }
+            buf.insert(buf.end(), chunk, chunk + n);
+        }
+        ::close(fd);
+        elements.deserialize(buf.data(), buf.size());
+    }
+
+    // Makes the directory entries of path durable, e.g. a renamed checkpoint.
+    void syncDirectory() {
+        std::string::size_type slash = path.rfind('/');
+        std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+        int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+        if (fd < 0) fail("open " + dir);
+        if (::fsync(fd) != 0) {
+            ::close(fd);
+            fail("fsync " + dir);
+        }
+        ::close(fd);
+    }
+
+    // FNV-1a over the record bytes except the checksum field itself
+    static std::uint32_t checksum(const Record &r) {
+        const unsigned char *bytes = reinterpret_cast<const unsigned char *>(&r);
+        std::uint32_t h = 2166136261u;
+        for (size_type i{0}; i < sizeof(Record); i++) {
+            if (i < sizeof(std::uint32_t) || i >= 2 * sizeof(std::uint32_t)) h = (h ^ bytes[i]) * 16777619u;
+        }
+        return h;
+    }
+
+    void writeAll(int fd, const char *buf, size_type len) {
+        while (len) {
+            ssize_t n = ::write(fd, buf, len);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                fail("write");
+            }
+            buf += n;
+            len -= static_cast<size_type>(n);
+        }
+    }
+
+    [[noreturn]] static void fail(const std::string &what) {
+        throw std::runtime_error{"ADS_durable_set: " + what + ": " + std::strerror(errno)};
+    }
+};
+
+#endif // ADS_DURABLE_SET_H
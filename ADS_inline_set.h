@@ -0,0 +1,297 @@
+#ifndef ADS_INLINE_SET_H
+#define ADS_INLINE_SET_H
+
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+
+#include "ADS_set.h"
+
+// Variant of ADS_set whose primary buckets live in the directory itself instead of
+// behind a Bucket* each, so a lookup reaches its first keys with one cache miss and
+// only overflow buckets cost a pointer hop. The directory is a fixed list of segments:
+// segment 0 holds buckets 0 and 1, segment s > 0 holds buckets [2^s, 2^(s+1)). The
+// table grows by allocating the next segment; buckets are never copied or moved.
+template <typename Key, size_t N = 7, typename Mixer = ads::default_mixer<Key>>
+class ADS_inline_set {
+public:
+    using value_type = Key;
+    using key_type = Key;
+    using size_type = size_t;
+    using key_equal = std::equal_to<key_type>;
+    using hasher = std::hash<key_type>;
+private:
+    // aligned so that a bucket of up to 64 bytes is read with a single cache line
+    struct alignas(64) Bucket {
+        size_type bucketSize{0};
+        Bucket* nextBucket{nullptr};
+        key_type entries[N]{};
+    };
+    static constexpr size_type maxSegments = 8 * sizeof(size_type);
+
+    size_type numOfElements;
+    size_type roundNumber;
+    size_type nextToSplit;
+    size_type tableSize;
+    size_type overflowBuckets;
+    size_type hashSeed;
+    Bucket* segments[maxSegments];
+public:
+    ADS_inline_set(): numOfElements{0}, roundNumber{1}, nextToSplit{0}, tableSize{2}, overflowBuckets{0}, hashSeed{ads::process_seed()}, segments{} {
+        segments[0] = new Bucket[2];
+    }
+
+    ADS_inline_set(std::initializer_list<key_type> ilist): ADS_inline_set{} {
+        for (const key_type& key : ilist) insert(key);
+    }
+
+    // Clones the segments and chains as they are, without rehashing a key. The empty
+    // segments are allocated first, so release() is safe if a copy throws.
+    ADS_inline_set(const ADS_inline_set &other): ADS_inline_set{} {
+        for (size_type s{1}; s <= segmentOf(other.tableSize - 1); s++) segments[s] = new Bucket[segmentSize(s)];
+        tableSize = other.tableSize;
+        roundNumber = other.roundNumber;
+        nextToSplit = other.nextToSplit;
+        hashSeed = other.hashSeed;
+        for (size_type i{0}; i < tableSize; i++) copyChain(bucket(i), other.bucket(i));
+        numOfElements = other.numOfElements;
+    }
+
+    ADS_inline_set &operator=(ADS_inline_set other) {
+        swap(other);
+        return *this;
+    }
+
+    ~ADS_inline_set() {
+        release();
+    }
+
+    size_type size() const {
+        return numOfElements;
+    }
+
+    bool empty() const {
+        return numOfElements == 0;
+    }
+
+    size_type bucket_count() const {
+        return tableSize;
+    }
+
+    size_type overflow_bucket_count() const {
+        return overflowBuckets;
+    }
+
+    // Directory segments, primary and overflow buckets.
+    size_type memory_bytes() const {
+        return sizeof(ADS_inline_set) + (segmentBase(segmentOf(tableSize - 1)) + segmentSize(segmentOf(tableSize - 1)) + overflowBuckets) * sizeof(Bucket);
+    }
+
+    bool insert(const key_type& key) {
+        Bucket* b = &bucket(getIndex(key));
+        for (;;) {
+            for (size_type i{0}; i < b->bucketSize; i++) {
+                if (key_equal{}(b->entries[i], key)) return false;
+            }
+            if (b->nextBucket == nullptr) break;
+            b = b->nextBucket;
+        }
+
+        numOfElements++;
+        if (append(*b, key)) split();
+        return true;
+    }
+
+    size_type count(const key_type& key) const {
+        for (const Bucket* b{&bucket(getIndex(key))}; b != nullptr; b = b->nextBucket) {
+            for (size_type i{0}; i < b->bucketSize; i++) {
+                if (key_equal{}(b->entries[i], key)) return 1;
+            }
+        }
+        return 0;
+    }
+
+    size_type erase(const key_type& key) {
+        Bucket* prev = nullptr;
+        for (Bucket* b{&bucket(getIndex(key))}; b != nullptr; prev = b, b = b->nextBucket) {
+            for (size_type i{0}; i < b->bucketSize; i++) {
+                if (!key_equal{}(b->entries[i], key)) continue;
+                std::move(b->entries + i + 1, b->entries + b->bucketSize, b->entries + i);
+                b->bucketSize--;
+                numOfElements--;
+                if (prev && b->bucketSize == 0) {
+                    prev->nextBucket = b->nextBucket;
+                    releaseBucket(b);
+                }
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    void clear() {
+        ADS_inline_set empty;
+        empty.hashSeed = hashSeed;
+        swap(empty);
+    }
+
+    void swap(ADS_inline_set &other) {
+        std::swap(numOfElements, other.numOfElements);
+        std::swap(roundNumber, other.roundNumber);
+        std::swap(nextToSplit, other.nextToSplit);
+        std::swap(tableSize, other.tableSize);
+        std::swap(overflowBuckets, other.overflowBuckets);
+        std::swap(hashSeed, other.hashSeed);
+        std::swap(segments, other.segments);
+    }
+
+    template <typename F>
+    void for_each(F f) const {
+        for (size_type i{0}; i < tableSize; i++) {
+            for (const Bucket* b{&bucket(i)}; b != nullptr; b = b->nextBucket) {
+                for (size_type j{0}; j < b->bucketSize; j++) f(static_cast<const key_type&>(b->entries[j]));
+            }
+        }
+    }
+
+    friend bool operator==(const ADS_inline_set &lhs, const ADS_inline_set &rhs) {
+        if (lhs.numOfElements != rhs.numOfElements) return false;
+        bool equal{true};
+        lhs.for_each([&](const key_type& key) { equal = equal && rhs.count(key); });
+        return equal;
+    }
+
+    friend bool operator!=(const ADS_inline_set &lhs, const ADS_inline_set &rhs) {
+        return !(lhs == rhs);
+    }
+
+private:
+    size_type getIndex(const key_type& key) const {
+        size_type h = Mixer::mix(hasher{}(key), hashSeed);
+        size_type index = h & ((size_type{1} << roundNumber) - 1);
+        if (index < nextToSplit) index = h & ((size_type{1} << (roundNumber + 1)) - 1);
+        return index;
+    }
+
+    static size_type segmentOf(size_type index) {
+        if (index < 2) return 0;
+#if defined(__GNUC__)
+        return 8 * sizeof(unsigned long long) - 1 - static_cast<size_type>(__builtin_clzll(index));
+#else
+        size_type s{0};
+        while (index >>= 1) s++;
+        return s;
+#endif
+    }
+
+    static size_type segmentBase(size_type s) {
+        return s ? size_type{1} << s : 0;
+    }
+
+    static size_type segmentSize(size_type s) {
+        return s ? size_type{1} << s : 2;
+    }
+
+    Bucket& bucket(size_type index) const {
+        size_type s = segmentOf(index);
+        return segments[s][index - segmentBase(s)];
+    }
+
+    // Appends key to the chain starting at head; returns true if that took a new
+    // overflow bucket, which is when the table splits. Rvalue keys are moved.
+    template <typename K>
+    bool append(Bucket& head, K&& key) {
+        Bucket* b = &head;
+        while (b->bucketSize == N) {
+            if (b->nextBucket == nullptr) {
+                b = b->nextBucket = new Bucket;
+                overflowBuckets++;
+                b->entries[b->bucketSize++] = std::forward<K>(key);
+                return true;
+            }
+            b = b->nextBucket;
+        }
+        b->entries[b->bucketSize++] = std::forward<K>(key);
+        return false;
+    }
+
+    // Copies the chain starting at from into the empty primary bucket to.
+    void copyChain(Bucket& to, const Bucket& from) {
+        Bucket* b = &to;
+        for (const Bucket* src{&from}; ; src = src->nextBucket) {
+            std::copy(src->entries, src->entries + src->bucketSize, b->entries);
+            b->bucketSize = src->bucketSize;
+            if (src->nextBucket == nullptr) return;
+            b = b->nextBucket = new Bucket;
+            overflowBuckets++;
+        }
+    }
+
+    void split() {
+        size_type index = nextToSplit++;
+        if ((tableSize & (tableSize - 1)) == 0) segments[segmentOf(tableSize)] = new Bucket[tableSize];
+        tableSize++;
+        partition(bucket(index), bucket(tableSize - 1), index);
+
+        if (nextToSplit == size_type{1} << roundNumber) {
+            roundNumber++;
+            nextToSplit = 0;
+        }
+    }
+
+    // As ADS_set::partition: keys that stay are compacted to the front of the chain,
+    // the others are appended to `moved`, emptied overflow buckets are released.
+    void partition(Bucket& head, Bucket& moved, size_type index) {
+        Bucket* out{&head};
+        size_type kept{0};
+        for (Bucket* b{&head}; b != nullptr; b = b->nextBucket) {
+            size_type n{b->bucketSize};
+            for (size_type i{0}; i < n; i++) {
+                if (getIndex(b->entries[i]) != index) {
+                    append(moved, std::move(b->entries[i]));
+                    continue;
+                }
+                if (kept == N) {
+                    out->bucketSize = N;
+                    out = out->nextBucket;
+                    kept = 0;
+                }
+                if (out != b || kept != i) out->entries[kept] = std::move(b->entries[i]);
+                kept++;
+            }
+        }
+
+        for (Bucket* b{out->nextBucket}; b != nullptr; ) {
+            Bucket* next = b->nextBucket;
+            releaseBucket(b);
+            b = next;
+        }
+        out->nextBucket = nullptr;
+        out->bucketSize = kept;
+    }
+
+    void releaseBucket(Bucket* b) {
+        overflowBuckets--;
+        delete b;
+    }
+
+    void release() {
+        for (size_type i{0}; i < tableSize; i++) {
+            for (Bucket* b{bucket(i).nextBucket}; b != nullptr; ) {
+                Bucket* next = b->nextBucket;
+                delete b;
+                b = next;
+            }
+        }
+        for (Bucket*& segment : segments) {
+            delete[] segment;
+            segment = nullptr;
+        }
+    }
+};
+
+template <typename Key, size_t N, typename Mixer>
+void swap(ADS_inline_set<Key,N,Mixer> &lhs, ADS_inline_set<Key,N,Mixer> &rhs) { lhs.swap(rhs); }
+
+#endif // ADS_INLINE_SET_H
@@ -5,10 +5,223 @@
 #include <algorithm>
 #include <iostream>
 #include <stdexcept>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <iterator>
+#include <vector>
+#include <type_traits>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <random>
+#include <new>
+#include <memory>
+
+#include "ADS_simd.h"
 //ONLY USED FOR DUMP
 #include <bitset>
 
-template <typename Key, size_t N =7>
+namespace ads {
+    // Binary encoding of a single key for ADS_set::serialize()/deserialize(). out.put(p, n)
+    // appends n bytes, in.get(p, n) reads n bytes. Specialise for other key types.
+    template <typename Key>
+    struct key_io {
+        static_assert(std::is_trivially_copyable<Key>::value, "ADS_set serialization needs a specialization of ads::key_io for this key type");
+
+        template <typename Out>
+        static void write(Out &out, const Key &key) { out.put(&key, sizeof(Key)); }
+
+        template <typename In>
+        static void read(In &in, Key &key) { in.get(&key, sizeof(Key)); }
+    };
+
+    template <typename C, typename T, typename A>
+    struct key_io<std::basic_string<C, T, A>> {
+        template <typename Out>
+        static void write(Out &out, const std::basic_string<C, T, A> &key) {
+            std::uint64_t len = key.size();
+            out.put(&len, sizeof(len));
+            out.put(key.data(), len * sizeof(C));
+        }
+
+        template <typename In>
+        static void read(In &in, std::basic_string<C, T, A> &key) {
+            std::uint64_t len;
+            in.get(&len, sizeof(len));
+            key.resize(len);
+            in.get(&key[0], len * sizeof(C));
+        }
+    };
+
+    // Instrumentation policy of ADS_set: static hooks called on the hot paths. All hooks
+    // are empty here, so the default policy compiles away completely.
+    struct no_instrumentation {
+        static void probe() {}                                       // a lookup entered a chain
+        static void compare() {}                                     // one key comparison
+        static void hop() {}                                         // a lookup followed an overflow link
+        static void split() {}
+        static void allocate() {}                                    // a bucket was allocated
+        static void release() {}                                     // a bucket was freed
+
+        // Events with the work done: keys rehashed by a split, directory slots copied,
+        // buckets walked to reach the end of a chain that got a new overflow bucket.
+        static void split_begin(size_t) {}                           // bucket
+        static void split_end(size_t, size_t) {}                     // bucket, keys rehashed
+        static void grow_begin(size_t) {}                            // directory capacity
+        static void grow_end(size_t, size_t) {}                      // old capacity, new capacity
+        static void round_advance(size_t, size_t) {}                 // new round, buckets
+        static void overflow_bucket(size_t) {}                       // new chain length
+    };
+
+    struct instrumentation_counters {
+        size_t probes;
+        size_t comparisons;
+        size_t hops;
+        size_t splits;
+        size_t allocations;
+        size_t releases;
+    };
+
+    // Counts every hook in counters private to the calling thread, so instrumented
+    // sets can be used from several threads without synchronisation.
+    struct counting_instrumentation: no_instrumentation {
+        static instrumentation_counters &counters() {
+            thread_local instrumentation_counters c{};
+            return c;
+        }
+        static void reset() { counters() = instrumentation_counters{}; }
+
+        static void probe() { counters().probes++; }
+        static void compare() { counters().comparisons++; }
+        static void hop() { counters().hops++; }
+        static void split() { counters().splits++; }
+        static void allocate() { counters().allocations++; }
+        static void release() { counters().releases++; }
+    };
+
+    // Mixing policies applied to hasher{}(key) and the table's seed before ADS_set masks
+    // off the low bits. Only mixers with seeded == true let a new seed move the keys.
+    struct no_mixer {
+        static constexpr bool seeded = false;
+        static size_t mix(size_t h, size_t) { return h; }
+        static void mix_batch(size_t *, size_t, size_t) {}
+    };
+
+    // Multiplication by 2^64 / golden ratio. Only the high bits of the product depend on
+    // all bits of h, so the bytes are reversed to bring them down to the masked end.
+    struct fibonacci_mixer {
+        static constexpr bool seeded = true;
+        static size_t mix(size_t h, size_t seed) {
+            std::uint64_t x = static_cast<std::uint64_t>(h ^ seed) * 0x9e3779b97f4a7c15ULL;
+#if defined(__GNUC__)
+            return static_cast<size_t>(__builtin_bswap64(x));
+#else
+            std::uint64_t r{0};
+            for (int i{0}; i < 8; i++, x >>= 8) r = r << 8 | (x & 0xff);
+            return static_cast<size_t>(r);
+#endif
+        }
+        static void mix_batch(size_t *h, size_t n, size_t seed) {
+            for (size_t i{simd::fibonacci_batch(simd::current(), h, n, seed)}; i < n; i++) h[i] = mix(h[i], seed);
+        }
+    };
+
+    // MurmurHash3 fmix64 finalizer, every input bit affects every output bit.
+    struct fmix64_mixer {
+        static constexpr bool seeded = true;
+        static size_t mix(size_t h, size_t seed) {
+            std::uint64_t x = h ^ seed;
+            x = (x ^ (x >> 33)) * 0xff51afd7ed558ccdULL;
+            x = (x ^ (x >> 33)) * 0xc4ceb9fe1a85ec53ULL;
+            return static_cast<size_t>(x ^ (x >> 33));
+        }
+        static void mix_batch(size_t *h, size_t n, size_t seed) {
+            for (size_t i{simd::fmix64_batch(simd::current(), h, n, seed)}; i < n; i++) h[i] = mix(h[i], seed);
+        }
+    };
+
+    // Whether Mixer mixes a batch of hashes in place with mix_batch(h, n, seed), as the
+    // mixers above do with the ads::simd kernels; others are called key by key.
+    template <typename Mixer, typename = void>
+    struct batch_mixer: std::false_type {};
+
+    template <typename Mixer>
+    struct batch_mixer<Mixer, std::void_t<decltype(Mixer::mix_batch(static_cast<size_t *>(nullptr), size_t{0}, size_t{0}))>>: std::true_type {};
+
+    // Whether std::hash<Key> is known to pass keys through unmixed (libstdc++ and libc++
+    // hash integers, enums and pointers to themselves). Specialise for own key types.
+    template <typename Key>
+    struct weak_hash: std::integral_constant<bool, std::is_integral<Key>::value || std::is_enum<Key>::value || std::is_pointer<Key>::value> {};
+
+    // Whether two keys are equal exactly when their bytes are (integers, enums, pointers;
+    // not floating point). Lets ADS_set compare and copy such keys as raw memory and scan
+    // buckets without branching. Specialise for own trivially copyable key types.
+    template <typename Key>
+    struct bitwise_equal: std::integral_constant<bool, std::is_integral<Key>::value || std::is_enum<Key>::value || std::is_pointer<Key>::value> {};
+
+    // Every default mixer is seeded, so the flooding defence also covers std::string and
+    // other keys whose std::hash is strong but public: fibonacci_mixer spreads the unmixed
+    // hashes of weak_hash keys, fmix64_mixer fully mixes hashes of unknown quality.
+    template <typename Key>
+    using default_mixer = typename std::conditional<weak_hash<Key>::value, fibonacci_mixer, fmix64_mixer>::type;
+
+    // Overflow policies: how a chain grows once its primary bucket is full. linked_overflow
+    // hangs further buckets of N keys onto the chain; contiguous_overflow keeps every key
+    // past the primary bucket in one spill bucket that is reallocated with twice the
+    // capacity when full, so a long chain is a single hop and a linear scan.
+    struct linked_overflow {
+        static constexpr bool contiguous = false;
+    };
+
+    struct contiguous_overflow {
+        static constexpr bool contiguous = true;
+    };
+
+    // Passed as N, ads::cache_lines(k) lets ADS_set pick the bucket capacity: as many keys
+    // as fit into k cache lines (k = 1, 2 or 4) next to the bucket header, with buckets
+    // aligned to cache lines.
+    constexpr size_t cache_line_size = 64;
+
+    constexpr size_t cache_lines(size_t k) {
+        return ~size_t{0} - k;
+    }
+
+    constexpr size_t lines_requested(size_t n) {
+        return n >= cache_lines(4) ? ~size_t{0} - n : 0;
+    }
+
+    // Keys per bucket for N, with Header bytes of bucket header; at least one key. Only
+    // takes sizeof(Key) for cache lines or integer keys, so a fixed N works with incomplete keys.
+    template <typename Key, size_t N, size_t Header, size_t Lines = lines_requested(N)>
+    struct keys_per_bucket {
+        static constexpr size_t value = Lines * cache_line_size >= Header + sizeof(Key) ? (Lines * cache_line_size - Header) / sizeof(Key) : 1;
+    };
+
+    template <typename Key, size_t N, size_t Header>
+    struct keys_per_bucket<Key, N, Header, 0> {
+        static constexpr size_t value = simd::round_capacity<Key>(N);
+    };
+
+    // A fresh unpredictable seed on every call.
+    inline size_t random_seed() {
+        static std::atomic<std::uint64_t> state{(static_cast<std::uint64_t>(std::random_device{}()) << 32) ^ std::random_device{}()};
+        std::uint64_t z = state.fetch_add(0x9e3779b97f4a7c15ULL) + 0x9e3779b97f4a7c15ULL;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return static_cast<size_t>(z ^ (z >> 31));
+    }
+
+    // Seed of new tables: random, but the same for the whole process, so that tables
+    // keep placing keys alike (see ADS_set::operator== and the set algebra) while
+    // keys cannot be prepared to collide in advance.
+    inline size_t process_seed() {
+        static const size_t seed = random_seed();
+        return seed;
+    }
+}
+
+template <typename Key, size_t N =7, typename Instrumentation = ads::no_instrumentation, typename Mixer = ads::default_mixer<Key>, typename Overflow = ads::linked_overflow>
 class ADS_set {
 public:
     class Iterator;
@@ -23,7 +236,32 @@ public:
     using key_compare = std::less<key_type>;                         // B+-Tree
     using key_equal = std::equal_to<key_type>;                       // Hashing
     using hasher = std::hash<key_type>;                              // Hashing
+    using instrumentation = Instrumentation;
+    using mixer = Mixer;
+    using overflow = Overflow;
+    template <typename I>
+    using instrumented = ADS_set<Key, N, I, Mixer, Overflow>;        // same table with another policy
+    template <typename O>
+    using with_overflow = ADS_set<Key, N, Instrumentation, Mixer, O>;
+
+    // Keys per bucket: N (rounded up to whole vectors for integer keys, see ads::simd),
+    // or what fits into the cache lines requested by ads::cache_lines.
+    static constexpr size_type bucket_capacity = ads::keys_per_bucket<Key, N, sizeof(size_type) + sizeof(void*) + (Overflow::contiguous ? sizeof(size_t) : 0)>::value;
+    static_assert(bucket_capacity > 0, "ADS_set needs room for at least one key per bucket");
 private:
+    static constexpr bool bitwiseKeys = std::is_trivially_copyable<Key>::value && ads::bitwise_equal<Key>::value;
+    static constexpr size_type bucketAlignment = ads::lines_requested(N) ? ads::cache_line_size : alignof(size_type);
+
+    // Key slots of a bucket; only spill buckets of contiguous_overflow hold more than bucket_capacity.
+    struct FixedCapacity {
+        static constexpr size_t capacity() { return bucket_capacity; }
+    };
+
+    struct StoredCapacity {
+        size_t slots{bucket_capacity};
+        size_t capacity() const { return slots; }
+    };
+
     struct Bucket;
     size_type numOfElements;
     size_type roundNumber;
@@ -31,10 +269,16 @@ private:
     size_type tableSize;
     size_type tableMaxSize;
     Bucket** buckets;
+    size_type hashSeed;
+    size_type maxChainFactor;
+    size_type sinceReseed;                                           // inserts since the last reseed
+    size_type reseedCount;
+    size_type splitCount;                                            // splits since construction, copies keep it
 public:
-    ADS_set(): numOfElements{0}, roundNumber{1}, nextToSplit{0}, tableSize{2}, tableMaxSize{4}, buckets{new Bucket*[tableMaxSize]} {
-        buckets[0] = new Bucket();
-        buckets[1] = new Bucket();
+    ADS_set(): numOfElements{0}, roundNumber{1}, nextToSplit{0}, tableSize{2}, tableMaxSize{4}, buckets{new Bucket*[tableMaxSize]},
+        hashSeed{ads::process_seed()}, maxChainFactor{8}, sinceReseed{0}, reseedCount{0}, splitCount{0} {
+        buckets[0] = nullptr;
+        buckets[1] = nullptr;
     }
 
     ADS_set(std::initializer_list<key_type> ilist): ADS_set{std::begin(ilist),std::end(ilist)} {}
@@ -44,7 +288,15 @@ public:
         insert(first, last);
     }
 
-    ADS_set(const ADS_set &other): ADS_set(other.begin(), other.end()) {}
+    ADS_set(const ADS_set &other): ADS_set{} {
+        resetGeometry(other.roundNumber, other.nextToSplit);
+        for (size_type i{0}; i < other.tableSize; i++) buckets[tableSize++] = copyChain(other.buckets[i]);
+        numOfElements = other.numOfElements;
+        hashSeed = other.hashSeed;
+        maxChainFactor = other.maxChainFactor;
+        reseedCount = other.reseedCount;
+        splitCount = other.splitCount;
+    }
 
     ~ADS_set() {
         for (size_type i{0}; i < tableSize; i++) deleteLinkedBuckets(buckets[i]);
@@ -81,37 +333,56 @@ public:
         size_t y {0};
     
         bool end {false};
+        if (!buckets[x]) buckets[x] = allocateBucket();
         Bucket* b = buckets[x];
+        Instrumentation::probe();
 
         while (!end) {
-            for (size_type i = 0; i < b->bucketSize; ++i) {
-                if (key_equal{}(b->entries[i], key)) {
-                    Iterator it (buckets, tableSize, x, y, i);
-                    return std::make_pair(it, false);
-                }
+            size_type i = slotOf(b, key);
+            if (i < b->bucketSize) {
+                Iterator it (buckets, tableSize, x, y, i);
+                return std::make_pair(it, false);
             }
             if (b->nextBucket == nullptr) {
                 end = true;
             } else {
                 y++;
-                b = b->nextBucket;
+                b = follow(b);
             }
         }
         
         numOfElements++;
-        if(b->append(key)) {
-            split();
-            return std::make_pair(find(key), true);
-        }
-
-        Iterator it (buckets, tableSize, x, y, b->bucketSize-1);
+        // a full spill bucket is reallocated, which needs its predecessor in the chain;
+        // contiguous chains also fill the first bucket with room, not necessarily b
+        bool moved = (Overflow::contiguous ? buckets[x] : b)->append(key, &b);
+        if (moved) split();
+        moved |= guardChain(chainUnits(x, y + 1));
+        if (moved) return std::make_pair(find(key), true);
+
+        Iterator it (buckets, tableSize, x, b, b->bucketSize-1);
         return std::make_pair(it, true);
     }
 
+    // Keys from forward iterators are hashed batchSize at a time and their buckets
+    // prefetched before they are added.
     template<typename InputIt> 
     void insert(InputIt first, InputIt last) {
-        for (InputIt it {first}; it != last; it++) {
-            add(*it);
+        if constexpr (!multiPass<InputIt>) {
+            for (InputIt it {first}; it != last; it++) {
+                add(*it);
+            }
+        } else {
+            InputIt keys[batchSize];
+            size_type hashes[batchSize];
+            while (first != last) {
+                size_type n{0};
+                for (; n < batchSize && first != last; ++first) keys[n++] = first;
+                size_type seed{hashSeed};
+                hashBatch(keys, n, hashes);
+                for (size_type i{0}; i < n; i++) prefetch(buckets[indexFromHash(hashes[i])]);
+                // a reseed while adding invalidates the remaining hashes
+                for (size_type i{0}; i < n; i++) addHashed(*keys[i], hashSeed == seed ? hashes[i] : Mixer::mix(hasher{}(*keys[i]), hashSeed));
+            }
         }
     }
 
@@ -124,26 +395,26 @@ public:
         unsigned index = getIndex(key);
 
         Bucket* prev {nullptr};
-        for (Bucket* b{buckets[index]}; b != nullptr; b = b->nextBucket) {
-            for (size_type i = 0; i < b->bucketSize; ++i) {
-                if (key_equal{}(b->entries[i], key)) {
-                    b->entries[i] = b->entries[b->bucketSize-1];
-                    b->bucketSize--;
-                    numOfElements--;
-
-                    if (b->bucketSize > 0 || !(prev || b->nextBucket)) return 1;
-
-                    if (!prev) {
-                        buckets[index] = b->nextBucket;
-                    } else if (!b->nextBucket) {
-                        prev->nextBucket = nullptr;
-                    } else {
-                        prev->nextBucket = b->nextBucket;
-                    }
-
-                    delete b;
-                    return 1;
+        Instrumentation::probe();
+        for (Bucket* b{buckets[index]}; b != nullptr; b = follow(b)) {
+            size_type i = slotOf(b, key);
+            if (i < b->bucketSize) {
+                b->entries[i] = b->entries[b->bucketSize-1];
+                b->bucketSize--;
+                numOfElements--;
+
+                if (b->bucketSize > 0) return 1;
+
+                if (!prev) {
+                    buckets[index] = b->nextBucket;
+                } else if (!b->nextBucket) {
+                    prev->nextBucket = nullptr;
+                } else {
+                    prev->nextBucket = b->nextBucket;
                 }
+
+                releaseBucket(b);
+                return 1;
             }
             prev = b;
         }
@@ -151,26 +422,104 @@ public:
         return 0;
     }
 
+    // Removes the key at pos without hashing it and returns the iterator to the key that
+    // followed it. The remaining keys keep their order, so erase(first, last) can step
+    // through the range.
+    iterator erase(const_iterator pos) {
+        size_type index = pos.bucketIndex;
+        Bucket* b = pos.currBucket;
+        Bucket* prev {nullptr};
+        for (Bucket* p{buckets[index]}; p != b; p = p->nextBucket) prev = p;
+
+        std::move(b->entries + pos.entryIndex + 1, b->entries + b->bucketSize, b->entries + pos.entryIndex);
+        b->bucketSize--;
+        numOfElements--;
+
+        if (b->bucketSize > 0) return Iterator(buckets, tableSize, index, b, pos.entryIndex);
+
+        Bucket* next = b->nextBucket;
+        if (!prev) buckets[index] = next;
+        else prev->nextBucket = next;
+        releaseBucket(b);
+        return next ? Iterator(buckets, tableSize, index, next, 0) : Iterator(buckets, tableSize, index + 1);
+    }
+
+    iterator erase(const_iterator first, const_iterator last) {
+        for (auto n = std::distance(first, last); n > 0; n--) first = erase(first);
+        return first;
+    }
+
+    // Removes every key for which pred(key) is true in one pass: the keys kept in a chain
+    // are compacted to its front and the overflow buckets left empty are freed.
+    template <typename Pred>
+    size_type erase_if(Pred pred) {
+        size_type removed{0};
+        for (size_type i{0}; i < tableSize; i++) {
+            Bucket* to = buckets[i];
+            if (!to) continue;
+            size_type k{0};
+            for (Bucket* b{buckets[i]}; b != nullptr; b = b->nextBucket) {
+                for (size_type j{0}; j < b->bucketSize; j++) {
+                    if (pred(static_cast<const key_type&>(b->entries[j]))) {
+                        removed++;
+                        continue;
+                    }
+                    if (k == to->capacity()) {
+                        to = to->nextBucket;
+                        k = 0;
+                    }
+                    if (to != b || k != j) to->entries[k] = std::move(b->entries[j]);
+                    k++;
+                }
+            }
+            Bucket* rest = to->nextBucket;
+            to->bucketSize = k;
+            to->nextBucket = nullptr;
+            for (Bucket* b{buckets[i]}; b != to; b = b->nextBucket) b->bucketSize = b->capacity();
+            deleteLinkedBuckets(rest);
+            if (k == 0) {
+                releaseBucket(buckets[i]);
+                buckets[i] = nullptr;
+            }
+        }
+        numOfElements -= removed;
+        return removed;
+    }
+
     size_type count(const key_type &key) const {
-        unsigned index = getIndex(key);
-        for (Bucket* b{buckets[index]}; b != nullptr; b = b->nextBucket) {
-            for (size_type i = 0; i < b->bucketSize; ++i) {
-                if (key_equal{}(b->entries[i], key)) return 1;
+        return inChain(buckets[getIndex(key)], key);
+    }
+
+    // count() of every key in [first, last), written to out. Keys from forward iterators
+    // are hashed and indexed batchSize at a time (see ads::simd) and all their buckets
+    // prefetched before the first is searched, so the cache misses of a batch overlap.
+    template <typename InputIt, typename OutputIt>
+    OutputIt count(InputIt first, InputIt last, OutputIt out) const {
+        if constexpr (!multiPass<InputIt>) {
+            for (; first != last; ++first) *out++ = count(*first);
+        } else {
+            InputIt keys[batchSize];
+            size_type hashes[batchSize], index[batchSize];
+            while (first != last) {
+                size_type n{0};
+                for (; n < batchSize && first != last; ++first) keys[n++] = first;
+                hashBatch(keys, n, hashes);
+                indexBatch(hashes, n, index);
+                for (size_type i{0}; i < n; i++) prefetch(buckets[index[i]]);
+                for (size_type i{0}; i < n; i++) *out++ = inChain(buckets[index[i]], *keys[i]);
             }
         }
-        return 0;
+        return out;
     }
 
     iterator find(const key_type &key) const {
         size_t x = static_cast<size_t>(getIndex(key));
         size_t y {0};
 
-        for (Bucket* b{buckets[x]}; b != nullptr; b = b->nextBucket) {
-            for (size_type i = 0; i < b->bucketSize; ++i) {
-                if (key_equal{}(b->entries[i], key)) {
-                    return Iterator(buckets, tableSize, x, y, i);
-                }
-            }
+        Instrumentation::probe();
+        for (Bucket* b{buckets[x]}; b != nullptr; b = follow(b)) {
+            size_type i = slotOf(b, key);
+            if (i < b->bucketSize) return Iterator(buckets, tableSize, x, y, i);
             y++;
         }
 
@@ -179,6 +528,11 @@ public:
 
     void swap(ADS_set &other) {
         std::swap(buckets, other.buckets);
+        std::swap(hashSeed, other.hashSeed);
+        std::swap(maxChainFactor, other.maxChainFactor);
+        std::swap(sinceReseed, other.sinceReseed);
+        std::swap(reseedCount, other.reseedCount);
+        std::swap(splitCount, other.splitCount);
         std::swap(nextToSplit, other.nextToSplit);
         std::swap(roundNumber, other.roundNumber);
         std::swap(tableSize, other.tableSize);
@@ -193,6 +547,117 @@ public:
         return const_iterator{};
     };
 
+    // Contiguous run of directory slots [first, last), e.g. one share of a parallel scan.
+    class bucket_range {
+        friend class ADS_set;
+        const ADS_set* set;
+        size_type first;
+        size_type last;
+    public:
+        bucket_range(const ADS_set* set, size_type first, size_type last): set{set}, first{first}, last{last} {}
+
+        const_iterator begin() const {
+            return const_iterator{set->buckets, last, first};
+        }
+        const_iterator end() const {
+            return const_iterator{};
+        }
+
+        template <typename F>
+        void for_each(F f) const {
+            set->visitWhile([&f](const key_type* entries, size_type n) {
+                for (size_type i{0}; i < n; i++) f(entries[i]);
+                return true;
+            }, first, last);
+        }
+    };
+
+    // Splits the directory into (at most) k disjoint ranges of about equal bucket count.
+    // The ranges stay valid until the next insert or erase.
+    std::vector<bucket_range> ranges(size_type k) const {
+        if (k == 0) k = 1;
+        if (k > tableSize) k = tableSize;
+        std::vector<bucket_range> result;
+        result.reserve(k);
+        for (size_type i{0}; i < k; i++) result.emplace_back(this, tableSize * i / k, tableSize * (i + 1) / k);
+        return result;
+    }
+
+    // Calls f(key) for every key from `threads` threads; f must be safe to call concurrently.
+    template <typename F>
+    void parallel_for_each(F f, unsigned threads = std::thread::hardware_concurrency()) const {
+        parallelRanges(threads, [this, &f](size_type first, size_type last) {
+            visitWhile([&f](const key_type* entries, size_type n) {
+                for (size_type i{0}; i < n; i++) f(entries[i]);
+                return true;
+            }, first, last);
+        });
+    }
+
+    // Calls f(key) for every key. Walks the directory and the chains directly, which
+    // is considerably cheaper than a begin()/end() loop.
+    template <typename F>
+    void for_each(F f) const {
+        visitWhile([&f](const key_type* entries, size_type n) {
+            for (size_type i{0}; i < n; i++) f(entries[i]);
+            return true;
+        });
+    }
+
+    // Calls f(entries, n) once for every non-empty bucket of every chain.
+    template <typename F>
+    void visit_buckets(F f) const {
+        visitWhile([&f](const key_type* entries, size_type n) {
+            f(entries, n);
+            return true;
+        });
+    }
+
+    struct table_stats {
+        size_type size;
+        size_type bucketCount;                                       // primary buckets
+        size_type overflowBuckets;
+        size_type splitCount;                                        // split() calls; results of set algebra and deserialize() start at 0
+        size_type reseedCount;                                       // rebuilds by the flooding defence
+        size_type maxChainLength;                                    // buckets in the longest chain
+        std::vector<size_type> chainLengths;                         // chainLengths[k]: chains of k buckets, 0 = unallocated slot
+        double loadFactor;                                           // elements per primary bucket slot
+        size_type directoryBytes;
+        size_type bucketBytes;
+        size_type wastedBytes;                                       // unused key slots
+        double bytesPerElement;
+    };
+
+    // Table health in one pass over the chains, without touching the keys.
+    table_stats stats() const {
+        table_stats st{};
+        st.size = numOfElements;
+        st.bucketCount = tableSize;
+        st.splitCount = splitCount;
+        st.reseedCount = reseedCount;
+        st.chainLengths.resize(2);
+
+        size_type slots{0};
+        for (size_type i{0}; i < tableSize; i++) {
+            size_type length{0};
+            for (const Bucket* b{buckets[i]}; b != nullptr; b = b->nextBucket) {
+                length++;
+                slots += b->capacity();
+                st.bucketBytes += bucketBytes(b->capacity());
+            }
+            if (length >= st.chainLengths.size()) st.chainLengths.resize(length + 1);
+            st.chainLengths[length]++;
+            st.overflowBuckets += length ? length - 1 : 0;
+            st.maxChainLength = std::max(st.maxChainLength, length);
+        }
+
+        st.loadFactor = static_cast<double>(numOfElements) / (tableSize * bucket_capacity);
+        st.directoryBytes = tableMaxSize * sizeof(Bucket*);
+        st.wastedBytes = (slots - numOfElements) * sizeof(key_type);
+        st.bytesPerElement = numOfElements ? static_cast<double>(sizeof(ADS_set) + st.directoryBytes + st.bucketBytes) / numOfElements : 0;
+        return st;
+    }
+
     void dump(std::ostream &o = std::cerr) const {
         o << "[size = " << numOfElements << "\n";
             for (size_type i{0}; i < tableSize; i++) {
@@ -215,38 +680,143 @@ public:
         }
     }
 
+    // Writes the table geometry followed by the contents of every bucket, so that
+    // deserialize() can rebuild the buckets without hashing or duplicate checks.
+    void serialize(std::ostream &o) const {
+        StreamSink out{o};
+        write(out);
+    }
+
+    void serialize(std::vector<char> &buf) const {
+        if constexpr (rawKeys) buf.reserve(buf.size() + sizeof(SerialHeader) + tableSize * sizeof(std::uint64_t) + numOfElements * sizeof(key_type));
+        BufferSink out{buf};
+        write(out);
+    }
+
+    void deserialize(std::istream &i) {
+        StreamSource in{i};
+        read(in);
+    }
+
+    void deserialize(const char *data, size_type len) {
+        BufferSource in{data, data + len};
+        read(in);
+    }
+
+    // With identical geometry every key has to be in the same bucket on both sides, so
+    // buckets are compared pairwise (sizes first, then keys) without hashing. Otherwise
+    // keys are looked up in the aligned bucket of the other table where there is one.
     friend bool operator==(const ADS_set &lhs, const ADS_set &rhs) {
         if (lhs.numOfElements != rhs.numOfElements) return false;
-        for (const auto& key : lhs) {
-            if (!rhs.count(key)) {
-                return false;
+
+        if (lhs.roundNumber == rhs.roundNumber && lhs.nextToSplit == rhs.nextToSplit && lhs.sameHash(rhs)) {
+            for (size_type i{0}; i < lhs.tableSize; i++) {
+                if (i + 1 < lhs.tableSize) {
+                    prefetch(lhs.buckets[i + 1]);
+                    prefetch(rhs.buckets[i + 1]);
+                }
+                if (chainSize(lhs.buckets[i]) != chainSize(rhs.buckets[i])) return false;
+                for (const Bucket* b{lhs.buckets[i]}; b != nullptr; b = b->nextBucket) {
+                    for (size_type k{0}; k < b->bucketSize; k++) {
+                        if (!inChain(rhs.buckets[i], b->entries[k])) return false;
+                    }
+                }
             }
-        };
+            return true;
+        }
 
-        return true;
+        const ADS_set &outer = lhs.tableSize >= rhs.tableSize ? lhs : rhs;
+        const ADS_set &inner = lhs.tableSize >= rhs.tableSize ? rhs : lhs;
+        return outer.alignedProbe(inner, 0, outer.tableSize, [](const key_type&, bool hit) { return hit; });
     }
 
     friend bool operator!=(const ADS_set &lhs, const ADS_set &rhs) {
         return !(lhs == rhs);
     }
 
+    // Set algebra. A key in bucket i of one table can only be in a few buckets of the
+    // other: when bucket i has been split at least as often as the other table's
+    // buckets, all its keys belong to one bucket there, which is then searched directly
+    // without hashing. threads > 1 processes disjoint bucket ranges concurrently.
+    size_type intersection_size(const ADS_set &other, unsigned threads = 1) const {
+        const ADS_set &outer = tableSize >= other.tableSize ? *this : other;
+        const ADS_set &inner = tableSize >= other.tableSize ? other : *this;
+        return outer.hitCount(inner, threads);
+    }
+
+    ADS_set set_intersection(const ADS_set &other, unsigned threads = 1) const {
+        const ADS_set &outer = tableSize >= other.tableSize ? *this : other;
+        const ADS_set &inner = tableSize >= other.tableSize ? other : *this;
+        return outer.filtered(inner, true, threads);
+    }
+
+    ADS_set set_difference(const ADS_set &other, unsigned threads = 1) const {
+        return filtered(other, false, threads);
+    }
+
+    // A copy of the larger set gets the keys of the smaller one added. With threads > 1
+    // the keys missing from the larger set are collected in parallel first, so that only
+    // those are added.
+    ADS_set set_union(const ADS_set &other, unsigned threads = 1) const {
+        const ADS_set &larger = tableSize >= other.tableSize ? *this : other;
+        const ADS_set &smaller = tableSize >= other.tableSize ? other : *this;
+        ADS_set result{larger};
+        if (threads <= 1) {
+            smaller.for_each([&result](const key_type& key) { result.add(key); });
+            return result;
+        }
+
+        std::vector<key_type> missing;
+        std::mutex m;
+        smaller.parallelRanges(threads, [&smaller, &larger, &missing, &m](size_type first, size_type last) {
+            std::vector<key_type> part;
+            smaller.alignedProbe(larger, first, last, [&part](const key_type& key, bool hit) {
+                if (!hit) part.push_back(key);
+                return true;
+            });
+            std::lock_guard<std::mutex> lock{m};
+            missing.insert(missing.end(), part.begin(), part.end());
+        });
+        for (const key_type& key : missing) result.add(key);
+        return result;
+    }
+
     unsigned getIndex(const key_type& key) const {
-        size_type hashedKey = hasher{}(key);
-        unsigned index = hashedKey & ((1u << roundNumber) - 1);
-        if (index < nextToSplit) index = hashedKey & ((1u << (roundNumber+1)) - 1);;
-        return index;
+        return indexFromHash(Mixer::mix(hasher{}(key), hashSeed));
     }
 
     void add(const key_type& key) {
-        unsigned index = getIndex(key);
-        for (Bucket* b{buckets[index]}; b != nullptr; b = b->nextBucket) {
-            for (size_type i = 0; i < b->bucketSize; ++i) {
-                if (key_equal{}(b->entries[i], key)) return;
-            }
-        }
-        
-        numOfElements++;
-        if (buckets[index]->append(key)) split();
+        addHashed(key, Mixer::mix(hasher{}(key), hashSeed));
+    }
+
+    size_type hash_seed() const {
+        return hashSeed;
+    }
+
+    // Rebuilds the table with every key placed by the given seed.
+    void reseed(size_type seed) {
+        ADS_set temp;
+        temp.resetGeometry(roundNumber, nextToSplit);
+        temp.hashSeed = seed;
+        for (size_type size{(size_type{1} << roundNumber) + nextToSplit}; temp.tableSize < size; ) temp.buckets[temp.tableSize++] = nullptr;
+        for_each([&temp](const key_type& key) { appendTo(temp.buckets[temp.getIndex(key)], key); });
+        temp.numOfElements = numOfElements;
+        temp.maxChainFactor = maxChainFactor;
+        temp.reseedCount = reseedCount;
+        temp.splitCount = splitCount;
+        swap(temp);
+    }
+
+    // Hash flooding defence: an insert into a chain of more than factor * (1 + load)
+    // buckets rebuilds the table with a random seed, at most once per size() inserts so
+    // that keys colliding in the full hash value cannot cause repeated rebuilds.
+    // 0 turns the check off; it is also off if the mixer ignores the seed.
+    void max_chain_factor(size_type factor) {
+        maxChainFactor = factor;
+    }
+
+    size_type max_chain_factor() const {
+        return maxChainFactor;
     }
 
     void deleteLinkedBuckets(Bucket* currentBucket) {
@@ -254,72 +824,589 @@ public:
             return;
         }
         deleteLinkedBuckets(currentBucket->nextBucket);
-        delete currentBucket;
+        releaseBucket(currentBucket);
     }
 
+    // The split event spans the directory growth it may trigger, so traces show the
+    // growth nested inside the split that caused it.
     void split() {
+        size_type index = nextToSplit;
+        Instrumentation::split();
+        Instrumentation::split_begin(index);
+        splitCount++;
         nextToSplit++;
         if (tableSize == tableMaxSize) {
-            tableMaxSize *= 2;
-            Bucket** newBuckets = new Bucket*[tableMaxSize];
+            Instrumentation::grow_begin(tableMaxSize);
+            growDirectory();
+            Instrumentation::grow_end(tableMaxSize / 2, tableMaxSize);
+        } 
 
-            for (size_type i{0}; i < tableSize; i++) {
-                newBuckets[i] = buckets[i];
+        buckets[tableSize++] = nullptr;
+        size_type rehashed = partition(buckets[index], buckets[tableSize-1], index);
+
+        if(nextToSplit == static_cast<size_type>(1 << roundNumber)) { 
+            roundNumber++; 
+            nextToSplit = 0; 
+            Instrumentation::round_advance(roundNumber, tableSize);
+        }
+        Instrumentation::split_end(index, rehashed);
+    }
+
+private:
+    // The low roundNumber bits, plus the next bit for buckets already split this round;
+    // without a branch, as the comparison with nextToSplit goes either way at random.
+    unsigned indexFromHash(size_type hashedKey) const {
+        unsigned index = hashedKey & ((1u << roundNumber) - 1);
+        return index | (hashedKey & (1u << roundNumber) & (0u - static_cast<unsigned>(index < nextToSplit)));
+    }
+
+    // add() of a key whose mixed hash is already known.
+    void addHashed(const key_type& key, size_type hashedKey) {
+        unsigned index = indexFromHash(hashedKey);
+        size_type chainLength{0};
+        Instrumentation::probe();
+        for (Bucket* b{buckets[index]}; b != nullptr; b = follow(b)) {
+            chainLength++;
+            if (slotOf(b, key) < b->bucketSize) return;
+        }
+        
+        numOfElements++;
+        if (appendTo(buckets[index], key)) split();
+        guardChain(chainUnits(index, chainLength));
+    }
+
+    // Splits the chain of bucket `index` in place: keys that stay are compacted to the
+    // front of the chain, the others are appended to `moved`, and only the buckets
+    // left empty at the end of the chain are released. Returns the number of keys rehashed.
+    size_type partition(Bucket*& head, Bucket*& moved, size_type index) {
+        size_type rehashed{0};
+        Bucket* out{head};
+        size_type kept{0};
+        for (Bucket* b{head}; b != nullptr; b = b->nextBucket) {
+            size_type n{b->bucketSize};
+            rehashed += n;
+            for (size_type i{0}; i < n; i++) {
+                if (getIndex(b->entries[i]) != index) {
+                    appendTo(moved, std::move(b->entries[i]));
+                    continue;
+                }
+                if (kept == out->capacity()) {
+                    out->bucketSize = kept;
+                    out = out->nextBucket;
+                    kept = 0;
+                }
+                if (out != b || kept != i) out->entries[kept] = std::move(b->entries[i]);
+                kept++;
             }
+        }
 
-            delete[] buckets;
-            buckets = newBuckets;
-        } 
+        if (out != nullptr) {
+            deleteLinkedBuckets(out->nextBucket);
+            out->nextBucket = nullptr;
+            out->bucketSize = kept;
+            if (kept == 0) {
+                releaseBucket(head);
+                head = nullptr;
+            }
+        }
+        return rehashed;
+    }
 
-        buckets[tableSize++] = new Bucket;
-        Bucket* newBucket = new Bucket;
-        for (Bucket* b{buckets[nextToSplit-1]}; b != nullptr; b = b->nextBucket) {
-            for (size_type i = 0; i < b->bucketSize; ++i) {
-                unsigned index = getIndex(b->entries[i]);
-                if (index == nextToSplit-1) newBucket->append(std::move(b->entries[i]));
-                else buckets[index]->append(std::move(b->entries[i]));
+    // Visits the buckets until f(entries, n) returns false; returns false if it did.
+    template <typename F>
+    bool visitWhile(F f) const {
+        return visitWhile(f, 0, tableSize);
+    }
+
+    template <typename F>
+    bool visitWhile(F f, size_type first, size_type last) const {
+        for (size_type i{first}; i < last; i++) {
+            if (i + 1 < last) prefetch(buckets[i + 1]);
+            for (const Bucket* b{buckets[i]}; b != nullptr; b = b->nextBucket) {
+                if (b->nextBucket) prefetch(b->nextBucket);
+                if (b->bucketSize && !f(b->entries, b->bucketSize)) return false;
             }
         }
+        return true;
+    }
 
-        deleteLinkedBuckets(buckets[nextToSplit-1]);
-        buckets[nextToSplit-1] = newBucket;
+    // Calls f(first, last) for disjoint bucket ranges covering the directory, from
+    // `threads` threads. There are more ranges than threads, so a thread that hits
+    // long chains doesn't hold up the rest.
+    template <typename F>
+    void parallelRanges(unsigned threads, F f) const {
+        if (threads <= 1) {
+            f(0, tableSize);
+            return;
+        }
 
+        std::vector<bucket_range> parts{ranges(threads * 8)};
+        std::atomic<size_type> next{0};
+        auto worker = [&parts, &next, &f] {
+            for (size_type i; (i = next.fetch_add(1)) < parts.size(); ) f(parts[i].first, parts[i].last);
+        };
 
-        if(nextToSplit == static_cast<size_type>(1 << roundNumber)) { 
-            roundNumber++; 
-            nextToSplit = 0; 
+        std::vector<std::thread> pool;
+        for (unsigned t{1}; t < threads; t++) pool.emplace_back(worker);
+        worker();
+        for (auto &t : pool) t.join();
+    }
+
+    size_type levelOf(size_type index) const {
+        return index < nextToSplit || index >= (size_type{1} << roundNumber) ? roundNumber + 1 : roundNumber;
+    }
+
+    static constexpr size_type npos = static_cast<size_type>(-1);
+
+    // Bucket holding every key whose hash agrees with index in the lowest `level` bits,
+    // or npos if such keys are spread over several buckets of this table.
+    size_type alignedIndex(size_type index, size_type level) const {
+        if (level > roundNumber) return indexFromHash(index);
+        if (level == roundNumber && index >= nextToSplit) return index;
+        return npos;
+    }
+
+    // Calls f(key, found) for every key of buckets [first, last), where found tells
+    // whether other contains the key, until f returns false; returns false if it did.
+    template <typename F>
+    bool alignedProbe(const ADS_set &other, size_type first, size_type last, F f) const {
+        bool aligned = sameHash(other);
+        for (size_type i{first}; i < last; i++) {
+            size_type j = aligned ? other.alignedIndex(i, levelOf(i)) : npos;
+            for (const Bucket* b{buckets[i]}; b != nullptr; b = b->nextBucket) {
+                for (size_type k{0}; k < b->bucketSize; k++) {
+                    const key_type& key = b->entries[k];
+                    if (!f(key, j != npos ? inChain(other.buckets[j], key) : other.count(key) != 0)) return false;
+                }
+            }
         }
+        return true;
+    }
+
+    // Whether both tables send every key to the same bucket at the same geometry.
+    bool sameHash(const ADS_set &other) const {
+        return !Mixer::seeded || hashSeed == other.hashSeed;
+    }
+
+    // Called after an insert into a chain of chainLength buckets; reseeds if the chain
+    // is suspiciously long. Returns true if it did.
+    bool guardChain(size_type chainLength) {
+        sinceReseed++;
+        if (!Mixer::seeded || chainLength <= maxChainFactor || maxChainFactor == 0) return false;
+        if (chainLength <= maxChainFactor * (1 + numOfElements / (tableSize * bucket_capacity)) || sinceReseed < numOfElements) return false;
+        sinceReseed = 0;
+        reseed(ads::random_seed());
+        reseedCount++;
+        return true;
+    }
+
+    // Length of chain `index` in buckets of bucket_capacity keys, the unit guardChain works in.
+    size_type chainUnits(size_type index, size_type chainBuckets) const {
+        return Overflow::contiguous ? chainSize(buckets[index]) / bucket_capacity + 1 : chainBuckets;
+    }
+
+    static size_type chainSize(const Bucket* b) {
+        size_type n{0};
+        for (; b != nullptr; b = b->nextBucket) n += b->bucketSize;
+        return n;
+    }
+
+    // Number of keys of *this that other contains.
+    size_type hitCount(const ADS_set &other, unsigned threads) const {
+        std::atomic<size_type> total{0};
+        parallelRanges(threads, [this, &other, &total](size_type first, size_type last) {
+            size_type found{0};
+            alignedProbe(other, first, last, [&found](const key_type&, bool hit) {
+                found += hit;
+                return true;
+            });
+            total += found;
+        });
+        return total;
+    }
+
+    // Keys of *this whose membership in other equals keep. The result gets a table just
+    // large enough for the keys, counted in a first pass (a sample misjudges keys that
+    // cluster in some buckets), with every bucket split fewer times than here; so result
+    // bucket j collects exactly the buckets j, j + (1 << round), j + 2 * (1 << round), ...
+    // of this table.
+    ADS_set filtered(const ADS_set &other, bool keep, unsigned threads) const {
+        size_type hits = hitCount(other, threads);
+        size_type expected = keep ? hits : numOfElements - hits;
+
+        size_type round{1};
+        while (round < roundNumber && (size_type{2} << round) * bucket_capacity * 2 <= expected * 3) round++;
+
+        ADS_set result;
+        result.resetGeometry(round, 0);
+        result.hashSeed = hashSeed;
+        while (result.tableSize < (size_type{1} << round)) result.buckets[result.tableSize++] = nullptr;
+
+        std::atomic<size_type> total{0};
+        result.parallelRanges(threads, [this, &other, &result, &total, keep, round](size_type first, size_type last) {
+            size_type kept{0};
+            for (size_type j{first}; j < last; j++) {
+                Bucket*& target = result.buckets[j];
+                for (size_type i{j}; i < tableSize; i += size_type{1} << round) {
+                    alignedProbe(other, i, i + 1, [&target, &kept, keep](const key_type& key, bool hit) {
+                        if (hit != keep) return true;
+                        appendTo(target, key);
+                        kept++;
+                        return true;
+                    });
+                }
+            }
+            total += kept;
+        });
+        result.numOfElements = total;
+        return result;
+    }
+
+    static bool inChain(const Bucket* b, const key_type& key) {
+        Instrumentation::probe();
+        for (; b != nullptr; b = follow(b)) {
+            if (slotOf(b, key) < b->bucketSize) return true;
+        }
+        return false;
+    }
+
+    // Position of key in bucket b, b->bucketSize if it is not there. Bitwise keys are
+    // compared against every slot of a bucket up to 64 slots, with the ads::simd kernels
+    // for integer keys, otherwise a fixed trip count without branches that the compiler
+    // unrolls; the first hit is the lowest set bit. Slots past bucketSize hold stale or
+    // value-initialized keys and are masked off.
+    static size_type slotOf(const Bucket* b, const key_type& key) {
+        size_type n{b->bucketSize};
+        if constexpr (bitwiseKeys && bucket_capacity <= 64) {
+            if (b->capacity() == bucket_capacity) {
+                std::uint64_t hits{0};
+                if constexpr (ads::simd::lanes<key_type>::value != 0) {
+                    Instrumentation::compare();                      // one vector compare per bucket
+                    hits = ads::simd::match(b->entries, bucket_capacity, key);
+                } else {
+                    for (size_type i{0}; i < bucket_capacity; ++i) hits |= std::uint64_t{equal(b->entries[i], key)} << i;
+                }
+                if (n < 64) hits &= (std::uint64_t{1} << n) - 1;
+                return hits ? lowestBit(hits) : n;
+            }
+        }
+        for (size_type i{0}; i < n; ++i) {
+            if (equal(b->entries[i], key)) return i;
+        }
+        return n;
+    }
+
+    static size_type lowestBit(std::uint64_t x) {
+#if defined(__GNUC__)
+        return static_cast<size_type>(__builtin_ctzll(x));
+#else
+        size_type i{0};
+        while (!(x & 1)) x >>= 1, i++;
+        return i;
+#endif
+    }
+
+    static Bucket* copyChain(const Bucket* src) {
+        if (src == nullptr) return nullptr;
+        Bucket* head = allocateBucket(src->capacity());
+        for (Bucket* b = head; ; b = b->nextBucket = allocateBucket(src->capacity())) {
+            if constexpr (bitwiseKeys) std::memcpy(b->entries, src->entries, src->bucketSize * sizeof(key_type));
+            else std::copy(src->entries, src->entries + src->bucketSize, b->entries);
+            b->bucketSize = src->bucketSize;
+            src = src->nextBucket;
+            if (src == nullptr) return head;
+        }
+    }
+
+    // Directory slots stay null until a key lands there. K is key_type or a reference to
+    // it; keys passed as rvalues are moved into the bucket.
+    template <typename K>
+    static bool appendTo(Bucket*& head, K&& key) {
+        if (head) return head->append(std::forward<K>(key));
+        head = allocateBucket();
+        head->entries[head->bucketSize++] = std::forward<K>(key);
+        return false;
+    }
+
+    static Bucket* allocateBucket(size_type capacity = bucket_capacity) {
+        Instrumentation::allocate();
+        if constexpr (Overflow::contiguous) {
+            if (capacity > bucket_capacity) {
+                Bucket* b = new (::operator new(bucketBytes(capacity), std::align_val_t{alignof(Bucket)})) Bucket;
+                std::uninitialized_value_construct(b->entries + bucket_capacity, b->entries + capacity);
+                b->slots = capacity;
+                return b;
+            }
+        }
+        return new Bucket;
+    }
+
+    static void releaseBucket(Bucket* b) {
+        Instrumentation::release();
+        if constexpr (Overflow::contiguous) {
+            if (b->capacity() > bucket_capacity) {
+                std::destroy(b->entries + bucket_capacity, b->entries + b->capacity());
+                b->~Bucket();
+                ::operator delete(b, std::align_val_t{alignof(Bucket)});
+                return;
+            }
+        }
+        delete b;
+    }
+
+    // Moves the keys of the full spill bucket linked from prev into one of twice the capacity.
+    static Bucket* widen(Bucket* prev, Bucket* spill) {
+        Bucket* wider = allocateBucket(2 * spill->capacity());
+        if constexpr (bitwiseKeys) std::memcpy(wider->entries, spill->entries, spill->bucketSize * sizeof(key_type));
+        else std::move(spill->entries, spill->entries + spill->bucketSize, wider->entries);
+        wider->bucketSize = spill->bucketSize;
+        prev->nextBucket = wider;
+        releaseBucket(spill);
+        return wider;
+    }
+
+    // Capacity of a new overflow bucket that is to receive `keys` keys.
+    static size_type spillCapacity(size_type keys) {
+        if (!Overflow::contiguous) return bucket_capacity;
+        size_type capacity{2 * bucket_capacity};
+        while (capacity < keys) capacity *= 2;
+        return capacity;
+    }
+
+    static constexpr size_type bucketBytes(size_type capacity) {
+        return sizeof(Bucket) + (capacity - bucket_capacity) * sizeof(key_type);
+    }
+
+    static bool equal(const key_type& lhs, const key_type& rhs) {
+        Instrumentation::compare();
+        if constexpr (bitwiseKeys) return std::memcmp(&lhs, &rhs, sizeof(key_type)) == 0;
+        else return key_equal{}(lhs, rhs);
+    }
+
+    // Next bucket of a chain during a lookup.
+    template <typename B>
+    static B* follow(B* b) {
+        if (b->nextBucket) Instrumentation::hop();
+        return b->nextBucket;
+    }
+
+    // Drops all buckets and prepares an empty directory for the given round; the
+    // caller fills buckets[0 .. (1 << round) + next) and counts them in tableSize,
+    // calling growDirectory() when it has room for fewer than that (at most slots).
+    void resetGeometry(size_type round, size_type next, size_type slots = npos) {
+        for (size_type i{0}; i < tableSize; i++) deleteLinkedBuckets(buckets[i]);
+        tableSize = 0;
+        delete[] buckets;
+        buckets = nullptr;
+        numOfElements = 0;
+        roundNumber = round;
+        nextToSplit = next;
+        tableMaxSize = std::min(size_type{1} << (round + 1), slots);
+        buckets = new Bucket*[tableMaxSize];
+    }
+
+    void growDirectory() {
+        tableMaxSize *= 2;
+        Bucket** newBuckets = new Bucket*[tableMaxSize];
+        std::copy(buckets, buckets + tableSize, newBuckets);
+        delete[] buckets;
+        buckets = newBuckets;
+    }
+
+    static constexpr size_type batchSize = 16;
+
+    template <typename It>
+    static constexpr bool multiPass = std::is_base_of<std::forward_iterator_tag, typename std::iterator_traits<It>::iterator_category>::value;
+
+    // Mixed hashes of the keys *keys[0 .. n) under the current seed.
+    template <typename It>
+    void hashBatch(const It* keys, size_type n, size_type* hashes) const {
+        for (size_type i{0}; i < n; i++) hashes[i] = hasher{}(*keys[i]);
+        if constexpr (ads::batch_mixer<Mixer>::value) {
+            Mixer::mix_batch(hashes, n, hashSeed);
+        } else {
+            for (size_type i{0}; i < n; i++) hashes[i] = Mixer::mix(hashes[i], hashSeed);
+        }
+    }
+
+    // indexFromHash() of n hashes.
+    void indexBatch(const size_type* hashes, size_type n, size_type* index) const {
+        size_type i{ads::simd::index_batch(ads::simd::current(), hashes, n, static_cast<unsigned>(roundNumber), nextToSplit, index)};
+        for (; i < n; i++) index[i] = indexFromHash(hashes[i]);
+    }
+
+    static void prefetch(const void* p) {
+#if defined(__GNUC__)
+        __builtin_prefetch(p);
+#else
+        (void)p;
+#endif
+    }
+
+    struct SerialHeader {
+        std::uint64_t magic;
+        std::uint64_t keySize;                                       // 0 if keys are written through ads::key_io
+        std::uint64_t numOfElements;
+        std::uint64_t roundNumber;
+        std::uint64_t nextToSplit;
+        std::uint64_t hashSeed;
+        std::uint64_t mixerTag;                                      // mixerTag() of the writer
+    };
+    static constexpr std::uint64_t serialMagic = 0x4144535f53455433; // "ADS_SET3"
+    static constexpr size_type readChunk = 4096;                     // keys allocated ahead of the input
+
+    // Tells mixers apart, so that a table is not read into a set that would place its keys elsewhere.
+    size_type mixerTag() const {
+        return Mixer::mix(static_cast<size_type>(serialMagic), hashSeed);
+    }
+    static constexpr bool rawKeys = std::is_trivially_copyable<key_type>::value;
+
+    struct StreamSink {
+        std::ostream &o;
+        void put(const void *p, size_type n) { o.write(static_cast<const char *>(p), static_cast<std::streamsize>(n)); }
+    };
+
+    struct BufferSink {
+        std::vector<char> &buf;
+        void put(const void *p, size_type n) { buf.insert(buf.end(), static_cast<const char *>(p), static_cast<const char *>(p) + n); }
+    };
+
+    struct StreamSource {
+        std::istream &i;
+        void get(void *p, size_type n) {
+            if (!i.read(static_cast<char *>(p), static_cast<std::streamsize>(n))) throw std::runtime_error{"ADS_set::deserialize: unexpected end of input"};
+        }
+    };
+
+    struct BufferSource {
+        const char *pos;
+        const char *last;
+        void get(void *p, size_type n) {
+            if (static_cast<size_type>(last - pos) < n) throw std::runtime_error{"ADS_set::deserialize: unexpected end of input"};
+            std::memcpy(p, pos, n);
+            pos += n;
+        }
+    };
+
+    template <typename Out>
+    void write(Out &out) const {
+        SerialHeader header{serialMagic, rawKeys ? sizeof(key_type) : 0, numOfElements, roundNumber, nextToSplit, hashSeed, mixerTag()};
+        out.put(&header, sizeof(header));
+
+        for (size_type i{0}; i < tableSize; i++) {
+            std::uint64_t bucketCount = chainSize(buckets[i]);
+            out.put(&bucketCount, sizeof(bucketCount));
+
+            for (Bucket* b{buckets[i]}; b != nullptr; b = b->nextBucket) {
+                if constexpr (rawKeys) {
+                    out.put(b->entries, b->bucketSize * sizeof(key_type));
+                } else {
+                    for (size_type j{0}; j < b->bucketSize; j++) ads::key_io<key_type>::write(out, b->entries[j]);
+                }
+            }
+        }
+    }
+
+    template <typename In>
+    void read(In &in) {
+        SerialHeader header;
+        in.get(&header, sizeof(header));
+        if (header.magic != serialMagic || header.keySize != (rawKeys ? sizeof(key_type) : 0) || header.roundNumber == 0 || header.roundNumber >= 32 || header.nextToSplit >= (std::uint64_t{1} << header.roundNumber))
+            throw std::runtime_error{"ADS_set::deserialize: input was not written by ADS_set::serialize for this key type"};
+
+        ADS_set temp;
+        temp.hashSeed = static_cast<size_type>(header.hashSeed);
+        if (header.mixerTag != temp.mixerTag()) throw std::runtime_error{"ADS_set::deserialize: input was written by an ADS_set with another mixer"};
+        // the header is not trusted with allocations: the directory grows with the bucket
+        // counts read and chains with the keys read, readChunk keys at a time
+        temp.resetGeometry(header.roundNumber, header.nextToSplit, readChunk);
+        temp.maxChainFactor = maxChainFactor;
+
+        size_type total{0};
+        for (size_type size{(size_type{1} << temp.roundNumber) + temp.nextToSplit}; temp.tableSize < size; ) {
+            std::uint64_t bucketCount;
+            in.get(&bucketCount, sizeof(bucketCount));
+            if (bucketCount > header.numOfElements - total) throw std::runtime_error{"ADS_set::deserialize: element count does not match the bucket contents"};
+            if (temp.tableSize == temp.tableMaxSize) temp.growDirectory();
+            Bucket* b = temp.buckets[temp.tableSize++] = bucketCount ? allocateBucket() : nullptr;
+            Bucket* prev{nullptr};
+            total += bucketCount;
+
+            while (bucketCount > 0) {
+                if (b->bucketSize == b->capacity()) {
+                    if (Overflow::contiguous && prev) {
+                        b = widen(prev, b);
+                    } else {
+                        prev = b;
+                        b = b->nextBucket = allocateBucket(spillCapacity(bucketCount < readChunk ? bucketCount : readChunk));
+                    }
+                }
+                size_type n = std::min(static_cast<size_type>(bucketCount), b->capacity() - b->bucketSize);
+                if constexpr (rawKeys) {
+                    in.get(b->entries + b->bucketSize, n * sizeof(key_type));
+                } else {
+                    for (size_type j{0}; j < n; j++) ads::key_io<key_type>::read(in, b->entries[b->bucketSize + j]);
+                }
+                b->bucketSize += n;
+                bucketCount -= n;
+            }
+
+            // a sample of the keys has to hash to where it was written, which catches
+            // tables written with another hasher
+            size_type i{temp.tableSize - 1};
+            if (i % 64 == 0 && temp.buckets[i] && temp.getIndex(temp.buckets[i]->entries[0]) != i)
+                throw std::runtime_error{"ADS_set::deserialize: keys are not where this set's hash places them"};
+        }
+
+        if (total != header.numOfElements) throw std::runtime_error{"ADS_set::deserialize: element count does not match the bucket contents"};
+        temp.numOfElements = total;
+        swap(temp);
     }
 };
 
-template <typename Key, size_t N>
-struct ADS_set<Key, N>::Bucket {
+template <typename Key, size_t N, typename Instrumentation, typename Mixer, typename Overflow>
+struct alignas(Key) alignas(ADS_set<Key, N, Instrumentation, Mixer, Overflow>::bucketAlignment) ADS_set<Key, N, Instrumentation, Mixer, Overflow>::Bucket: std::conditional<Overflow::contiguous, StoredCapacity, FixedCapacity>::type {
   size_type bucketSize{0};
-  key_type entries[N]{};
   Bucket* nextBucket{nullptr};
-
-  bool append(const key_type& key) {
+  key_type entries[bucket_capacity]{};                               // capacity() keys, spill buckets continue past the array
+
+  // Returns true if the key needed room beyond the chain's full buckets, which is
+  // when the table splits; spill buckets count every bucket_capacity keys they hold as one bucket.
+  // The key becomes the last entry of the bucket stored in *at, if given.
+  template <typename K>
+  bool append(K&& key, Bucket** at = nullptr) {
+    Bucket* prev = nullptr;
     Bucket* curr = this;
+    size_type length{1};
 
-    while (curr->bucketSize == N) {
+    while (curr->bucketSize == curr->capacity()) {
       if (curr->nextBucket == nullptr) {
-        curr->nextBucket = new Bucket;
-        curr = curr->nextBucket;
-        curr->entries[0] = key;
-        curr->bucketSize++;
+        if (Overflow::contiguous && prev) {
+          curr = widen(prev, curr);
+        } else {
+          prev = curr;
+          curr = curr->nextBucket = allocateBucket(Overflow::contiguous ? 2 * bucket_capacity : bucket_capacity);
+          length++;
+        }
+        Instrumentation::overflow_bucket(length);
+        curr->entries[curr->bucketSize++] = std::forward<K>(key);
+        if (at) *at = curr;
         return true;
       }
 
+      prev = curr;
       curr = curr->nextBucket;
+      length++;
     }
 
-    curr->entries[curr->bucketSize++] = key;
-    return false;
+    curr->entries[curr->bucketSize++] = std::forward<K>(key);
+    if (at) *at = curr;
+    return Overflow::contiguous && prev && curr->bucketSize % bucket_capacity == 1 % bucket_capacity;
   }
 };
 
-template <typename Key, size_t N>
-class ADS_set<Key,N>::Iterator {
+template <typename Key, size_t N, typename Instrumentation, typename Mixer, typename Overflow>
+class ADS_set<Key,N,Instrumentation,Mixer,Overflow>::Iterator {
 public:
     using value_type = Key;
     using difference_type = std::ptrdiff_t;
@@ -335,6 +1422,8 @@ private:
     size_type entryIndex; 
     pointer currPtr; 
 
+    friend class ADS_set;
+
     void advanceToNextValidBucket() {
         while (bucketIndex < tableSize) {
             Bucket* bucket = buckets[bucketIndex];
@@ -356,7 +1445,7 @@ private:
     }
 
 public:
-    explicit Iterator(Bucket** buckets, size_t tableSize) : buckets{buckets}, tableSize{tableSize}, bucketIndex{0}, entryIndex{0} {
+    explicit Iterator(Bucket** buckets, size_t tableSize, size_t firstBucket = 0) : buckets{buckets}, tableSize{tableSize}, bucketIndex{firstBucket}, entryIndex{0} {
         advanceToNextValidBucket();
     }
 
@@ -373,6 +1462,24 @@ public:
         currPtr = &currBucket->entries[entryIndex];
     }
 
+    // First key at or after entry entryIndex of bucket, a bucket of chain bucketIndex.
+    Iterator(Bucket** buckets, size_t tableSize, size_t bucketIndex, Bucket* bucket, size_t entryIndex) :
+        buckets{buckets},
+        tableSize{tableSize},
+        bucketIndex{bucketIndex},
+        entryIndex{entryIndex} {
+
+        for (currBucket = bucket; currBucket != nullptr; currBucket = currBucket->nextBucket, this->entryIndex = 0) {
+            if (this->entryIndex < currBucket->bucketSize) {
+                currPtr = &currBucket->entries[this->entryIndex];
+                return;
+            }
+        }
+        ++this->bucketIndex;
+        this->entryIndex = 0;
+        advanceToNextValidBucket();
+    }
+
     Iterator(): buckets{nullptr}, 
         currBucket{nullptr}, 
         tableSize{0}, 
@@ -425,7 +1532,10 @@ public:
 };
 
 
-template <typename Key, size_t N>
-void swap(ADS_set<Key,N> &lhs, ADS_set<Key,N> &rhs) { lhs.swap(rhs); }
+template <typename Key, size_t N, typename Instrumentation, typename Mixer, typename Overflow>
+void swap(ADS_set<Key,N,Instrumentation,Mixer,Overflow> &lhs, ADS_set<Key,N,Instrumentation,Mixer,Overflow> &rhs) { lhs.swap(rhs); }
+
+template <typename Key, size_t N, typename Instrumentation, typename Mixer, typename Overflow, typename Pred>
+size_t erase_if(ADS_set<Key,N,Instrumentation,Mixer,Overflow> &set, Pred pred) { return set.erase_if(pred); }
 
 #endif // ADS_SET_H
\ No newline at end of file
@@ -0,0 +1,343 @@
+#ifndef ADS_SIMD_H
+#define ADS_SIMD_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <type_traits>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define ADS_SIMD_X86 1
+#endif
+
+namespace ads {
+    // Bucket search for 32 and 64 bit integer keys: the probe key is broadcast into a
+    // vector register and compared against a whole bucket at once, giving a mask with
+    // bit i set if slot i holds the key. SSE2 is the x86-64 baseline; AVX2 and AVX-512
+    // are used when CPUID reports them. The environment variable ADS_SIMD (scalar, sse2,
+    // avx2 or avx512) caps the level, e.g. to run the tests on the scalar fallback.
+    namespace simd {
+        enum level { scalar, sse2, avx2, avx512 };
+
+        inline const char *name(level l) {
+            static const char *const names[] = {"scalar", "sse2", "avx2", "avx512"};
+            return names[l];
+        }
+
+        // Highest level this CPU supports; avx512 means the F, BW and DQ subsets.
+        inline level supported() {
+#ifdef ADS_SIMD_X86
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512dq")) return avx512;
+            if (__builtin_cpu_supports("avx2")) return avx2;
+            return sse2;
+#else
+            return scalar;
+#endif
+        }
+
+        inline level &current() {
+            static level l = [] {
+                level best = supported();
+                const char *cap = std::getenv("ADS_SIMD");
+                for (int i = scalar; cap && i < best; i++) {
+                    if (std::strcmp(cap, name(static_cast<level>(i))) == 0) return static_cast<level>(i);
+                }
+                return best;
+            }();
+            return l;
+        }
+
+        // Selects the level used from now on, at most supported(); returns the one in effect.
+        inline level select(level l) {
+            return current() = l < supported() ? l : supported();
+        }
+
+        // Keys per vector of the narrowest kernel, 0 for keys searched with plain compares.
+        template <typename Key, bool = std::is_integral<Key>::value && !std::is_same<Key, bool>::value>
+        struct lanes: std::integral_constant<size_t, 0> {};
+
+        template <typename Key>
+        struct lanes<Key, true>: std::integral_constant<size_t, sizeof(Key) == 4 || sizeof(Key) == 8 ? 16 / sizeof(Key) : 0> {};
+
+        // Bucket capacity for N keys: rounded up to whole SSE2 vectors for vectorized keys,
+        // unless N is smaller than one vector.
+        template <typename Key>
+        constexpr size_t round_capacity(size_t n) {
+            return lanes<Key>::value && n >= lanes<Key>::value ? (n + lanes<Key>::value - 1) / lanes<Key>::value * lanes<Key>::value : n;
+        }
+
+        // Match masks of keys[0 .. n) against key, for n <= 64. Every kernel reads exactly
+        // the n keys; tails shorter than a vector are compared one by one or with masked loads.
+        template <typename Key>
+        std::uint64_t match_scalar(const Key *keys, size_t n, Key key) {
+            std::uint64_t hits{0};
+            for (size_t i{0}; i < n; ++i) hits |= std::uint64_t{keys[i] == key} << i;
+            return hits;
+        }
+
+#ifdef ADS_SIMD_X86
+        inline std::uint64_t match32_sse2(const void *p, size_t n, std::uint32_t key) {
+            const char *keys = static_cast<const char *>(p);
+            __m128i k = _mm_set1_epi32(static_cast<int>(key));
+            std::uint64_t hits{0};
+            size_t full = n & ~size_t{3};
+            for (size_t i{0}; i < full; i += 4) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(keys + 4 * i));
+                hits |= std::uint64_t(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v, k)))) << i;
+            }
+            for (size_t i{full}; i < n; ++i) {
+                std::uint32_t x;
+                std::memcpy(&x, keys + 4 * i, 4);
+                hits |= std::uint64_t{x == key} << i;
+            }
+            return hits;
+        }
+
+        // SSE2 has no 64 bit compare: both halves have to match.
+        inline std::uint64_t match64_sse2(const void *p, size_t n, std::uint64_t key) {
+            const char *keys = static_cast<const char *>(p);
+            __m128i k = _mm_set1_epi64x(static_cast<long long>(key));
+            std::uint64_t hits{0};
+            size_t full = n & ~size_t{1};
+            for (size_t i{0}; i < full; i += 2) {
+                __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(keys + 8 * i)), k);
+                eq = _mm_and_si128(eq, _mm_shuffle_epi32(eq, 0xb1));
+                hits |= std::uint64_t(_mm_movemask_pd(_mm_castsi128_pd(eq))) << i;
+            }
+            if (full < n) {
+                std::uint64_t x;
+                std::memcpy(&x, keys + 8 * full, 8);
+                hits |= std::uint64_t{x == key} << full;
+            }
+            return hits;
+        }
+
+        __attribute__((target("avx2")))
+        inline std::uint64_t match32_avx2(const void *p, size_t n, std::uint32_t key) {
+            const char *keys = static_cast<const char *>(p);
+            __m256i k = _mm256_set1_epi32(static_cast<int>(key));
+            std::uint64_t hits{0};
+            size_t i{0};
+            for (; i + 8 <= n; i += 8) {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys + 4 * i));
+                hits |= std::uint64_t(static_cast<std::uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(v, k))))) << i;
+            }
+            return i < n ? hits | match32_sse2(keys + 4 * i, n - i, key) << i : hits;
+        }
+
+        __attribute__((target("avx2")))
+        inline std::uint64_t match64_avx2(const void *p, size_t n, std::uint64_t key) {
+            const char *keys = static_cast<const char *>(p);
+            __m256i k = _mm256_set1_epi64x(static_cast<long long>(key));
+            std::uint64_t hits{0};
+            size_t i{0};
+            for (; i + 4 <= n; i += 4) {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys + 8 * i));
+                hits |= std::uint64_t(static_cast<std::uint32_t>(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(v, k))))) << i;
+            }
+            return i < n ? hits | match64_sse2(keys + 8 * i, n - i, key) << i : hits;
+        }
+
+        __attribute__((target("avx512f")))
+        inline std::uint64_t match32_avx512(const void *p, size_t n, std::uint32_t key) {
+            const char *keys = static_cast<const char *>(p);
+            __m512i k = _mm512_set1_epi32(static_cast<int>(key));
+            std::uint64_t hits{0};
+            for (size_t i{0}; i < n; i += 16) {
+                __mmask16 live = n - i >= 16 ? __mmask16(0xffff) : __mmask16((1u << (n - i)) - 1);
+                __m512i v = _mm512_maskz_loadu_epi32(live, keys + 4 * i);
+                hits |= std::uint64_t(_mm512_mask_cmpeq_epi32_mask(live, v, k)) << i;
+            }
+            return hits;
+        }
+
+        __attribute__((target("avx512f")))
+        inline std::uint64_t match64_avx512(const void *p, size_t n, std::uint64_t key) {
+            const char *keys = static_cast<const char *>(p);
+            __m512i k = _mm512_set1_epi64(static_cast<long long>(key));
+            std::uint64_t hits{0};
+            for (size_t i{0}; i < n; i += 8) {
+                __mmask8 live = n - i >= 8 ? __mmask8(0xff) : __mmask8((1u << (n - i)) - 1);
+                __m512i v = _mm512_maskz_loadu_epi64(live, keys + 8 * i);
+                hits |= std::uint64_t(_mm512_mask_cmpeq_epi64_mask(live, v, k)) << i;
+            }
+            return hits;
+        }
+#endif
+
+        // Kernel of level l; l must not exceed supported().
+        template <typename Key>
+        std::uint64_t match(level l, const Key *keys, size_t n, Key key) {
+            static_assert(lanes<Key>::value != 0, "ads::simd::match needs 32 or 64 bit integer keys");
+#ifdef ADS_SIMD_X86
+            if constexpr (sizeof(Key) == 4) {
+                std::uint32_t k = static_cast<std::uint32_t>(key);
+                if (l == avx512) return match32_avx512(keys, n, k);
+                if (l == avx2) return match32_avx2(keys, n, k);
+                if (l == sse2) return match32_sse2(keys, n, k);
+            } else {
+                std::uint64_t k = static_cast<std::uint64_t>(key);
+                if (l == avx512) return match64_avx512(keys, n, k);
+                if (l == avx2) return match64_avx2(keys, n, k);
+                if (l == sse2) return match64_sse2(keys, n, k);
+            }
+#else
+            (void)l;
+#endif
+            return match_scalar(keys, n, key);
+        }
+
+        // Kernel of the current level. Up to one cache line of keys (a bucket of 16 int or
+        // 8 uint64_t) stays with SSE2: it is inlined and at most four compares, while the
+        // out-of-line AVX2 and AVX-512 kernels measured slower on buckets that small.
+        template <typename Key>
+        std::uint64_t match(const Key *keys, size_t n, Key key) {
+            level l = current();
+            if (l > sse2 && n * sizeof(Key) <= 64) l = sse2;
+            return match(l, keys, n, key);
+        }
+
+        // Batch hashing for ADS_set::count(first, last, out) and insert(first, last): the
+        // multiply-xorshift mixers of ADS_set.h and the bucket index of linear hashing, on 4
+        // (AVX2) or 8 (AVX-512) hashes per instruction. Each returns how many of the n
+        // hashes it handled, a multiple of the vector width; the caller does the rest with
+        // the scalar code, which is also all there is below AVX2 (SSE2 has no 64 bit
+        // multiply or compare).
+#ifdef ADS_SIMD_X86
+        // 64 bit multiply from 32 bit ones: lo * lo + (hi * lo + lo * hi) << 32
+        __attribute__((target("avx2")))
+        inline __m256i mullo64_avx2(__m256i a, __m256i b) {
+            __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b), _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+            return _mm256_add_epi64(_mm256_mul_epu32(a, b), _mm256_slli_epi64(cross, 32));
+        }
+
+        __attribute__((target("avx2")))
+        inline size_t fibonacci_avx2(size_t *h, size_t n, size_t seed) {
+            const __m256i s = _mm256_set1_epi64x(static_cast<long long>(seed));
+            const __m256i c = _mm256_set1_epi64x(static_cast<long long>(0x9e3779b97f4a7c15ULL));
+            const __m256i reverse = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+            size_t i{0};
+            for (; i + 4 <= n; i += 4) {
+                __m256i x = mullo64_avx2(_mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(h + i)), s), c);
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(h + i), _mm256_shuffle_epi8(x, reverse));
+            }
+            return i;
+        }
+
+        __attribute__((target("avx2")))
+        inline size_t fmix64_avx2(size_t *h, size_t n, size_t seed) {
+            const __m256i s = _mm256_set1_epi64x(static_cast<long long>(seed));
+            const __m256i c1 = _mm256_set1_epi64x(static_cast<long long>(0xff51afd7ed558ccdULL));
+            const __m256i c2 = _mm256_set1_epi64x(static_cast<long long>(0xc4ceb9fe1a85ec53ULL));
+            size_t i{0};
+            for (; i + 4 <= n; i += 4) {
+                __m256i x = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(h + i)), s);
+                x = mullo64_avx2(_mm256_xor_si256(x, _mm256_srli_epi64(x, 33)), c1);
+                x = mullo64_avx2(_mm256_xor_si256(x, _mm256_srli_epi64(x, 33)), c2);
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(h + i), _mm256_xor_si256(x, _mm256_srli_epi64(x, 33)));
+            }
+            return i;
+        }
+
+        // index = h & (2^round - 1), plus bit `round` of h where that is below next; next
+        // is below 2^round, so a signed compare will do.
+        __attribute__((target("avx2")))
+        inline size_t index_avx2(const size_t *h, size_t n, unsigned round, size_t next, size_t *out) {
+            const __m256i low = _mm256_set1_epi64x(static_cast<long long>((std::uint64_t{1} << round) - 1));
+            const __m256i bit = _mm256_set1_epi64x(static_cast<long long>(std::uint64_t{1} << round));
+            const __m256i nxt = _mm256_set1_epi64x(static_cast<long long>(next));
+            size_t i{0};
+            for (; i + 4 <= n; i += 4) {
+                __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(h + i));
+                __m256i index = _mm256_and_si256(x, low);
+                __m256i split = _mm256_cmpgt_epi64(nxt, index);
+                index = _mm256_or_si256(index, _mm256_and_si256(split, _mm256_and_si256(x, bit)));
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), index);
+            }
+            return i;
+        }
+
+        __attribute__((target("avx512f,avx512bw,avx512dq")))
+        inline size_t fibonacci_avx512(size_t *h, size_t n, size_t seed) {
+            const __m512i s = _mm512_set1_epi64(static_cast<long long>(seed));
+            const __m512i c = _mm512_set1_epi64(static_cast<long long>(0x9e3779b97f4a7c15ULL));
+            const __m512i reverse = _mm512_set_epi64(0x08090a0b0c0d0e0f, 0x0001020304050607, 0x08090a0b0c0d0e0f, 0x0001020304050607,
+                                                     0x08090a0b0c0d0e0f, 0x0001020304050607, 0x08090a0b0c0d0e0f, 0x0001020304050607);
+            size_t i{0};
+            for (; i + 8 <= n; i += 8) {
+                __m512i x = _mm512_mullo_epi64(_mm512_xor_si512(_mm512_loadu_si512(h + i), s), c);
+                _mm512_storeu_si512(h + i, _mm512_shuffle_epi8(x, reverse));
+            }
+            return i;
+        }
+
+        // x ^ x >> 33; the unmasked _mm512_srli_epi64 trips -Wmaybe-uninitialized in GCC 12's headers
+        __attribute__((target("avx512f")))
+        inline __m512i xorshift33_avx512(__m512i x) {
+            return _mm512_xor_si512(x, _mm512_maskz_srli_epi64(__mmask8(0xff), x, 33));
+        }
+
+        __attribute__((target("avx512f,avx512bw,avx512dq")))
+        inline size_t fmix64_avx512(size_t *h, size_t n, size_t seed) {
+            const __m512i s = _mm512_set1_epi64(static_cast<long long>(seed));
+            const __m512i c1 = _mm512_set1_epi64(static_cast<long long>(0xff51afd7ed558ccdULL));
+            const __m512i c2 = _mm512_set1_epi64(static_cast<long long>(0xc4ceb9fe1a85ec53ULL));
+            size_t i{0};
+            for (; i + 8 <= n; i += 8) {
+                __m512i x = _mm512_xor_si512(_mm512_loadu_si512(h + i), s);
+                x = _mm512_mullo_epi64(xorshift33_avx512(x), c1);
+                x = _mm512_mullo_epi64(xorshift33_avx512(x), c2);
+                _mm512_storeu_si512(h + i, xorshift33_avx512(x));
+            }
+            return i;
+        }
+
+        __attribute__((target("avx512f,avx512bw,avx512dq")))
+        inline size_t index_avx512(const size_t *h, size_t n, unsigned round, size_t next, size_t *out) {
+            const __m512i low = _mm512_set1_epi64(static_cast<long long>((std::uint64_t{1} << round) - 1));
+            const __m512i bit = _mm512_set1_epi64(static_cast<long long>(std::uint64_t{1} << round));
+            const __m512i nxt = _mm512_set1_epi64(static_cast<long long>(next));
+            size_t i{0};
+            for (; i + 8 <= n; i += 8) {
+                __m512i x = _mm512_loadu_si512(h + i);
+                __m512i index = _mm512_and_si512(x, low);
+                __mmask8 split = _mm512_cmplt_epu64_mask(index, nxt);
+                _mm512_storeu_si512(out + i, _mm512_mask_or_epi64(index, split, index, _mm512_and_si512(x, bit)));
+            }
+            return i;
+        }
+#endif
+
+        inline size_t fibonacci_batch(level l, size_t *h, size_t n, size_t seed) {
+#ifdef ADS_SIMD_X86
+            if (l == avx512) return fibonacci_avx512(h, n, seed);
+            if (l == avx2) return fibonacci_avx2(h, n, seed);
+#endif
+            (void)l, (void)h, (void)n, (void)seed;
+            return 0;
+        }
+
+        inline size_t fmix64_batch(level l, size_t *h, size_t n, size_t seed) {
+#ifdef ADS_SIMD_X86
+            if (l == avx512) return fmix64_avx512(h, n, seed);
+            if (l == avx2) return fmix64_avx2(h, n, seed);
+#endif
+            (void)l, (void)h, (void)n, (void)seed;
+            return 0;
+        }
+
+        inline size_t index_batch(level l, const size_t *h, size_t n, unsigned round, size_t next, size_t *out) {
+#ifdef ADS_SIMD_X86
+            if (l == avx512) return index_avx512(h, n, round, next, out);
+            if (l == avx2) return index_avx2(h, n, round, next, out);
+#endif
+            (void)l, (void)h, (void)n, (void)round, (void)next, (void)out;
+            return 0;
+        }
+    }
+}
+
+#endif // ADS_SIMD_H
@@ -0,0 +1,160 @@
+#ifndef ADS_TRACE_H
+#define ADS_TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+
+#include "ADS_set.h"
+
+namespace ads {
+    // Timestamped table events, recorded into a fixed-size ring by any number of
+    // threads without locking; once full, the oldest events are overwritten.
+    // Dump the buffer while no traced set is being modified.
+    class trace_buffer {
+    public:
+        enum kind : std::uint32_t { split, directory_growth, round_advance, overflow_bucket };
+
+        struct event {
+            std::uint64_t start;                                     // ns since the buffer was created
+            std::uint64_t duration;                                  // ns, splits and directory growth only
+            std::uint32_t kind;
+            std::uint32_t thread;
+            std::uint64_t arg0;
+            std::uint64_t arg1;
+        };
+
+        static constexpr size_t capacity = size_t{1} << 20;
+
+        static trace_buffer &instance() {
+            static trace_buffer buffer;
+            return buffer;
+        }
+
+        std::uint64_t now() const {
+            return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count());
+        }
+
+        void record(std::uint32_t k, std::uint64_t start, std::uint64_t duration, std::uint64_t arg0, std::uint64_t arg1 = 0) {
+            std::uint64_t slot = head.fetch_add(1, std::memory_order_relaxed);
+            events[slot % capacity] = event{start, duration, k, threadId(), arg0, arg1};
+        }
+
+        size_t size() const {
+            std::uint64_t n = head.load(std::memory_order_acquire);
+            return n < capacity ? static_cast<size_t>(n) : capacity;
+        }
+
+        // Events dropped because the ring wrapped around.
+        size_t overwritten() const {
+            std::uint64_t n = head.load(std::memory_order_acquire);
+            return n < capacity ? 0 : static_cast<size_t>(n - capacity);
+        }
+
+        // The i-th retained event, oldest first (i < size()). Events are recorded when
+        // they end, so a directory growth comes before the split that triggered it.
+        const event &operator[](size_t i) const {
+            std::uint64_t n = head.load(std::memory_order_acquire);
+            std::uint64_t first = n < capacity ? 0 : n - capacity;
+            return events[(first + i) % capacity];
+        }
+
+        void clear() {
+            head.store(0, std::memory_order_release);
+        }
+
+        // Writes the recorded events, oldest first, in the Chrome trace-event format
+        // (load with chrome://tracing or ui.perfetto.dev).
+        void write_chrome_trace(std::ostream &o) const {
+            static const char *const names[] = {"split", "directory_growth", "round_advance", "overflow_bucket"};
+            static const char *const args[][2] = {{"bucket", "rehashed"}, {"from", "to"}, {"round", "buckets"}, {"chain_length", ""}};
+
+            std::uint64_t last = head.load(std::memory_order_acquire);
+            std::uint64_t first = last < capacity ? 0 : last - capacity;
+            o << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+            for (std::uint64_t i{first}; i < last; i++) {
+                const event &e = events[i % capacity];
+                o << (i == first ? "\n" : ",\n")
+                  << "{\"name\":\"" << names[e.kind] << "\",\"cat\":\"ADS_set\",\"pid\":1,\"tid\":" << e.thread
+                  << ",\"ts\":" << e.start / 1000 << '.' << digits(e.start % 1000);
+                if (e.kind == split || e.kind == directory_growth) o << ",\"ph\":\"X\",\"dur\":" << e.duration / 1000 << '.' << digits(e.duration % 1000);
+                else o << ",\"ph\":\"i\",\"s\":\"t\"";
+                o << ",\"args\":{\"" << args[e.kind][0] << "\":" << e.arg0;
+                if (*args[e.kind][1]) o << ",\"" << args[e.kind][1] << "\":" << e.arg1;
+                o << "}}";
+            }
+            o << "\n]}\n";
+        }
+
+    private:
+        std::unique_ptr<event[]> events;
+        std::atomic<std::uint64_t> head;
+        std::chrono::steady_clock::time_point origin;
+
+        trace_buffer(): events{new event[capacity]}, head{0}, origin{std::chrono::steady_clock::now()} {}
+
+        static std::uint32_t threadId() {
+            static std::atomic<std::uint32_t> threads{0};
+            thread_local std::uint32_t id = ++threads;
+            return id;
+        }
+
+        // three-digit fraction of a microsecond
+        struct digits {
+            std::uint64_t n;
+            explicit digits(std::uint64_t n): n{n} {}
+            friend std::ostream &operator<<(std::ostream &o, digits d) {
+                return o << static_cast<char>('0' + d.n / 100) << static_cast<char>('0' + d.n / 10 % 10) << static_cast<char>('0' + d.n % 10);
+            }
+        };
+    };
+
+    // Instrumentation policy recording splits, directory growth, round advances and new
+    // overflow buckets into trace_buffer::instance().
+    struct tracing_instrumentation: no_instrumentation {
+        static void split_begin(size_t) {
+            splitStart() = trace_buffer::instance().now();
+        }
+
+        static void split_end(size_t bucket, size_t rehashed) {
+            trace_buffer &t = trace_buffer::instance();
+            std::uint64_t start = splitStart();
+            t.record(trace_buffer::split, start, t.now() - start, bucket, rehashed);
+        }
+
+        static void grow_begin(size_t) {
+            growStart() = trace_buffer::instance().now();
+        }
+
+        static void grow_end(size_t from, size_t to) {
+            trace_buffer &t = trace_buffer::instance();
+            std::uint64_t start = growStart();
+            t.record(trace_buffer::directory_growth, start, t.now() - start, from, to);
+        }
+
+        static void round_advance(size_t round, size_t buckets) {
+            trace_buffer &t = trace_buffer::instance();
+            t.record(trace_buffer::round_advance, t.now(), 0, round, buckets);
+        }
+
+        static void overflow_bucket(size_t chainLength) {
+            trace_buffer &t = trace_buffer::instance();
+            t.record(trace_buffer::overflow_bucket, t.now(), 0, chainLength);
+        }
+
+    private:
+        static std::uint64_t &splitStart() {
+            thread_local std::uint64_t start{0};
+            return start;
+        }
+
+        static std::uint64_t &growStart() {
+            thread_local std::uint64_t start{0};
+            return start;
+        }
+    };
+}
+
+#endif // ADS_TRACE_H
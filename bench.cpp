@@ -0,0 +1,968 @@
+// Benchmarks ADS_set with several bucket sizes against std::unordered_set and std::set.
+//
+// g++ -Wall -Wextra -Werror -O3 -std=c++17 -pedantic-errors bench.cpp -o bench
+//
+// Every combination of container, key type and size runs the phases insert, hit
+// lookup, miss lookup, iteration, mixed and erase on a fresh container; after the
+// warmup runs, the time per operation of each phase is reported as median, mean,
+// standard deviation and minimum over the repetitions, as CSV or JSON on stdout.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <set>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "ADS_set.h"
+#include "ADS_inline_set.h"
+#include "ADS_compact_set.h"
+
+// 64 byte key, compared and hashed by its id
+struct big_key {
+    std::uint64_t id;
+    char payload[56];
+
+    friend bool operator==(const big_key &lhs, const big_key &rhs) { return lhs.id == rhs.id; }
+    friend bool operator<(const big_key &lhs, const big_key &rhs) { return lhs.id < rhs.id; }
+    friend std::ostream &operator<<(std::ostream &o, const big_key &k) { return o << k.id; }
+};
+
+namespace std {
+    template <>
+    struct hash<big_key> {
+        size_t operator()(const big_key &k) const { return std::hash<std::uint64_t>{}(k.id); }
+    };
+}
+
+// B byte key (B >= 8), compared and hashed by its id like big_key
+template <size_t B>
+struct sized_key {
+    std::uint64_t id;
+    char payload[B - sizeof(std::uint64_t)];
+
+    friend bool operator==(const sized_key &lhs, const sized_key &rhs) { return lhs.id == rhs.id; }
+};
+
+namespace std {
+    template <size_t B>
+    struct hash<sized_key<B>> {
+        size_t operator()(const sized_key<B> &k) const { return std::hash<std::uint64_t>{}(k.id); }
+    };
+}
+
+// T behind its own operator==, so ADS_set treats it as an arbitrary key and takes the
+// generic paths, not those for ads::bitwise_equal keys
+template <typename T>
+struct opaque_key {
+    T v;
+
+    friend bool operator==(const opaque_key &lhs, const opaque_key &rhs) { return lhs.v == rhs.v; }
+};
+
+namespace std {
+    template <typename T>
+    struct hash<opaque_key<T>> {
+        size_t operator()(const opaque_key<T> &k) const { return std::hash<T>{}(k.v); }
+    };
+}
+
+// unsigned key like SafeUnsigned in simpletest.cpp, but every Group consecutive values
+// share a hash value and therefore always a chain
+template <unsigned Group>
+struct colliding_key {
+    unsigned u;
+
+    friend bool operator==(const colliding_key &lhs, const colliding_key &rhs) { return lhs.u == rhs.u; }
+};
+
+namespace std {
+    template <unsigned Group>
+    struct hash<colliding_key<Group>> {
+        size_t operator()(const colliding_key<Group> &k) const { return k.u / Group; }
+    };
+}
+
+// splitmix64 finalizer, a bijection, so distinct i yield distinct keys
+std::uint64_t mix64(std::uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// murmur3 fmix32, a bijection on 32 bit values
+std::uint32_t mix32(std::uint32_t z) {
+    z = (z ^ (z >> 16)) * 0x85ebca6bU;
+    z = (z ^ (z >> 13)) * 0xc2b2ae35U;
+    return z ^ (z >> 16);
+}
+
+template <typename Key> Key key_at(std::uint64_t i);
+
+template <> int key_at<int>(std::uint64_t i) {
+    return static_cast<int>(mix32(static_cast<std::uint32_t>(i)));
+}
+
+template <> std::uint64_t key_at<std::uint64_t>(std::uint64_t i) {
+    return mix64(i);
+}
+
+template <> std::string key_at<std::string>(std::uint64_t i) {
+    static const char hex[] = "0123456789abcdef";
+    std::string s = "key:";
+    for (std::uint64_t z = mix64(i); z; z >>= 4) s += hex[z & 15];
+    return s;
+}
+
+template <> big_key key_at<big_key>(std::uint64_t i) {
+    big_key k;
+    k.id = mix64(i);
+    std::memset(k.payload, static_cast<int>(k.id & 0xff), sizeof(k.payload));
+    return k;
+}
+
+template <size_t B>
+sized_key<B> sized_at(std::uint64_t i) {
+    sized_key<B> k;
+    k.id = mix64(i);
+    std::memset(k.payload, static_cast<int>(k.id & 0xff), sizeof(k.payload));
+    return k;
+}
+
+struct result {
+    std::string container;
+    std::string key;
+    size_t n;
+    std::string op;
+    size_t ops;
+    std::vector<double> nanos;                                       // ns/op of every measured repetition
+};
+
+struct options {
+    size_t min_n = 1000;
+    size_t max_n = 1'000'000;
+    size_t reps = 5;
+    size_t warmup = 1;
+    std::uint64_t seed = 666;
+    std::string keys = "int,u64,string,struct";
+    std::string containers = "ads1,ads7,ads16,unordered,set";
+    std::string format = "csv";
+    bool mixers = false;
+    bool flood = false;
+    bool erase = false;
+    bool memory = false;
+    bool split = false;
+    bool collisions = false;
+    bool inline_buckets = false;
+    bool handles = false;
+    bool cache_lines = false;
+    bool bitwise = false;
+    bool vector_kernels = false;
+    bool index_batch = false;
+};
+
+volatile size_t sink;
+
+bool selected(const std::string &list, const std::string &name) {
+    size_t pos = 0;
+    while (pos <= list.size()) {
+        size_t end = list.find(',', pos);
+        if (end == std::string::npos) end = list.size();
+        if (list.compare(pos, end - pos, name) == 0) return true;
+        pos = end + 1;
+    }
+    return false;
+}
+
+template <typename F>
+double time_ms(F f) {
+    auto start = std::chrono::high_resolution_clock::now();
+    f();
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+template <typename Set, typename Key>
+void run(const char *container, const char *key, size_t n, const options &opt, std::vector<result> &results, Key (*make)(std::uint64_t) = key_at<Key>) {
+    std::mt19937_64 gen{opt.seed};
+    std::vector<Key> hits(n), misses(n), inserts(n), mixed(n);
+    std::vector<unsigned char> kinds(n);
+    for (size_t i = 0; i < n; ++i) {
+        hits[i] = make(i);
+        misses[i] = make(n + i);
+        inserts[i] = make(2 * n + i);
+    }
+    // mixed: 50% lookups (half of them misses), 25% inserts of new keys, 25% erases
+    for (size_t i = 0; i < n; ++i) {
+        kinds[i] = static_cast<unsigned char>(gen() % 4);
+        mixed[i] = kinds[i] == 1 ? misses[i] : kinds[i] == 2 ? inserts[i] : hits[gen() % n];
+    }
+    std::vector<Key> lookups{hits};
+    std::shuffle(lookups.begin(), lookups.end(), gen);
+
+    const char *ops[] = {"insert", "count_hit", "count_miss", "iterate", "mixed", "erase"};
+    size_t first = results.size();
+    for (const char *op : ops) results.push_back(result{container, key, n, op, n, {}});
+
+    for (size_t rep = 0; rep < opt.warmup + opt.reps; ++rep) {
+        double ms[6];
+        size_t found = 0;
+        {
+            Set s;
+            ms[0] = time_ms([&] { for (const Key &k : hits) s.insert(k); });
+            ms[1] = time_ms([&] { for (const Key &k : lookups) found += s.count(k); });
+            ms[2] = time_ms([&] { for (const Key &k : misses) found += s.count(k); });
+            ms[3] = time_ms([&] { for (auto it = s.begin(); it != s.end(); ++it) found += sizeof(*it); });
+            ms[4] = time_ms([&] {
+                for (size_t i = 0; i < n; ++i) {
+                    if (kinds[i] < 2) found += s.count(mixed[i]);
+                    else if (kinds[i] == 2) s.insert(mixed[i]);
+                    else found += s.erase(mixed[i]);
+                }
+            });
+            ms[5] = time_ms([&] { for (const Key &k : lookups) found += s.erase(k); });
+        }
+        sink = found;
+        if (rep < opt.warmup) continue;
+        for (size_t i = 0; i < 6; ++i) results[first + i].nanos.push_back(ms[i] * 1e6 / n);
+    }
+}
+
+template <typename Key>
+void run_key(const char *key, size_t n, const options &opt, std::vector<result> &results) {
+    if (!selected(opt.keys, key)) return;
+    std::cerr << key << ", n = " << n << '\n';
+    if (selected(opt.containers, "ads1")) run<ADS_set<Key, 1>, Key>("ADS_set<N=1>", key, n, opt, results);
+    if (selected(opt.containers, "ads7")) run<ADS_set<Key, 7>, Key>("ADS_set<N=7>", key, n, opt, results);
+    if (selected(opt.containers, "ads16")) run<ADS_set<Key, 16>, Key>("ADS_set<N=16>", key, n, opt, results);
+    if (selected(opt.containers, "unordered")) run<std::unordered_set<Key>, Key>("std::unordered_set", key, n, opt, results);
+    if (selected(opt.containers, "set")) run<std::set<Key>, Key>("std::set", key, n, opt, results);
+}
+
+// Integer key patterns for the hash mixer comparison (-M).
+std::uint64_t sequential_key(std::uint64_t i) { return i; }
+std::uint64_t strided_key(std::uint64_t i) { return i << 10; }
+std::uint64_t random_key(std::uint64_t i) { return mix64(i); }
+
+template <typename Mixer>
+void run_mixer(const char *container, size_t n, const options &opt, std::vector<result> &results) {
+    using set_t = ADS_set<std::uint64_t, 7, ads::no_instrumentation, Mixer>;
+    struct { const char *name; std::uint64_t (*make)(std::uint64_t); } patterns[] = {
+        {"sequential", sequential_key}, {"strided", strided_key}, {"random", random_key},
+    };
+    for (auto const &p : patterns) {
+        if (!selected(opt.keys, p.name)) continue;
+        set_t s;
+        for (size_t i = 0; i < n; ++i) s.insert(p.make(i));
+        auto st = s.stats();
+        std::cerr << container << ", " << p.name << ", n = " << n << ": max chain = " << st.maxChainLength
+                  << " buckets, overflow buckets = " << st.overflowBuckets << '\n';
+        run<set_t, std::uint64_t>(container, p.name, n, opt, results, p.make);
+    }
+}
+
+template <unsigned Group>
+colliding_key<Group> colliding_at(std::uint64_t i) {
+    return colliding_key<Group>{static_cast<unsigned>(i)};
+}
+
+// Chains of Group colliding keys at N = 1, linked overflow buckets against one
+// contiguous spill bucket per chain (-C).
+template <unsigned Group>
+void run_collisions(size_t n, const options &opt, std::vector<result> &results) {
+    using linked_t = ADS_set<colliding_key<Group>, 1>;
+    using contiguous_t = typename linked_t::template with_overflow<ads::contiguous_overflow>;
+    std::string key = "collide" + std::to_string(Group);
+    if (!selected(opt.keys, key)) return;
+
+    linked_t l;
+    contiguous_t c;
+    for (size_t i = 0; i < n; ++i) {
+        l.insert(colliding_at<Group>(i));
+        c.insert(colliding_at<Group>(i));
+    }
+    auto ls = l.stats();
+    auto cs = c.stats();
+    std::cerr << key << ", n = " << n << ": max chain = " << ls.maxChainLength << " linked / " << cs.maxChainLength
+              << " contiguous buckets, bytes/element = " << ls.bytesPerElement << " / " << cs.bytesPerElement << '\n';
+
+    run<linked_t, colliding_key<Group>>("ADS_set<N=1,linked>", key.c_str(), n, opt, results, colliding_at<Group>);
+    run<contiguous_t, colliding_key<Group>>("ADS_set<N=1,contiguous>", key.c_str(), n, opt, results, colliding_at<Group>);
+}
+
+// Fixed N = 7 against buckets sized to 1, 2 and 4 cache lines for one key type (-L).
+template <typename Key>
+void run_cache_lines(const char *key, size_t n, const options &opt, std::vector<result> &results, Key (*make)(std::uint64_t)) {
+    if (!selected(opt.keys, key)) return;
+    std::cerr << key << " (" << sizeof(Key) << " bytes), n = " << n << ": keys/bucket = 7, "
+              << ADS_set<Key, ads::cache_lines(1)>::bucket_capacity << ", " << ADS_set<Key, ads::cache_lines(2)>::bucket_capacity
+              << ", " << ADS_set<Key, ads::cache_lines(4)>::bucket_capacity << '\n';
+    run<ADS_set<Key, 7>, Key>("ADS_set<N=7>", key, n, opt, results, make);
+    run<ADS_set<Key, ads::cache_lines(1)>, Key>("ADS_set<1 line>", key, n, opt, results, make);
+    run<ADS_set<Key, ads::cache_lines(2)>, Key>("ADS_set<2 lines>", key, n, opt, results, make);
+    run<ADS_set<Key, ads::cache_lines(4)>, Key>("ADS_set<4 lines>", key, n, opt, results, make);
+}
+
+template <typename Key>
+opaque_key<Key> opaque_at(std::uint64_t i) {
+    return opaque_key<Key>{key_at<Key>(i)};
+}
+
+// Copy construction of a table of n keys.
+template <typename Set, typename Key>
+void run_copy(const char *container, const char *key, size_t n, const options &opt, std::vector<result> &results, Key (*make)(std::uint64_t)) {
+    Set s;
+    for (size_t i = 0; i < n; ++i) s.insert(make(i));
+    size_t first = results.size();
+    results.push_back(result{container, key, n, "copy", n, {}});
+    for (size_t rep = 0; rep < opt.warmup + opt.reps; ++rep) {
+        size_t copied = 0;
+        double ms = time_ms([&] { Set t{s}; copied = t.size(); });
+        sink = copied;
+        if (rep >= opt.warmup) results[first].nanos.push_back(ms * 1e6 / n);
+    }
+}
+
+// int and uint64_t keys on the paths for bitwise comparable keys (branchless bucket
+// scans, memcmp, memcpy) against the same keys wrapped in opaque_key (-B). Both use
+// the fibonacci mixer, so the tables have the same shape.
+template <typename Key>
+void run_bitwise(const char *key, size_t n, const options &opt, std::vector<result> &results) {
+    if (!selected(opt.keys, key)) return;
+    using bitwise_t = ADS_set<Key, 7, ads::no_instrumentation, ads::fibonacci_mixer>;
+    using generic_t = ADS_set<opaque_key<Key>, 7, ads::no_instrumentation, ads::fibonacci_mixer>;
+    std::cerr << key << ", n = " << n << '\n';
+    run<bitwise_t, Key>("ADS_set<bitwise>", key, n, opt, results);
+    run_copy<bitwise_t, Key>("ADS_set<bitwise>", key, n, opt, results, key_at<Key>);
+    run<generic_t, opaque_key<Key>>("ADS_set<generic>", key, n, opt, results, opaque_at<Key>);
+    run_copy<generic_t, opaque_key<Key>>("ADS_set<generic>", key, n, opt, results, opaque_at<Key>);
+}
+
+// The ads::simd bucket search kernels on their own: n probes (half of them hits) into
+// 4096 buckets of Capacity keys, each kernel level checked against the scalar one on
+// the same buckets and probes.
+template <typename Key, size_t Capacity>
+void run_match(const char *key, size_t n, const options &opt, std::vector<result> &results) {
+    constexpr size_t buckets = 4096;
+    std::mt19937_64 gen{opt.seed};
+    std::vector<Key> keys(buckets * Capacity);
+    for (size_t i = 0; i < keys.size(); ++i) keys[i] = key_at<Key>(i);
+    std::vector<std::pair<size_t, Key>> probes(n);
+    for (auto &p : probes) {
+        p.first = gen() % buckets;
+        p.second = gen() % 2 ? keys[p.first * Capacity + gen() % Capacity] : key_at<Key>(keys.size() + gen());
+    }
+    std::vector<std::uint64_t> expected(n);
+    for (size_t i = 0; i < n; ++i) expected[i] = ads::simd::match_scalar(&keys[probes[i].first * Capacity], Capacity, probes[i].second);
+
+    for (int l = ads::simd::scalar; l <= ads::simd::supported(); ++l) {
+        auto level = static_cast<ads::simd::level>(l);
+        for (size_t i = 0; i < n; ++i) {
+            if (ads::simd::match(level, &keys[probes[i].first * Capacity], Capacity, probes[i].second) != expected[i]) {
+                std::cerr << ads::simd::name(level) << ": wrong match mask for " << key << " buckets of " << Capacity << " keys\n";
+                std::exit(1);
+            }
+        }
+        size_t first = results.size();
+        results.push_back(result{std::string{"match<"} + ads::simd::name(level) + ",cap=" + std::to_string(Capacity) + ">", key, n, "match", n, {}});
+        for (size_t rep = 0; rep < opt.warmup + opt.reps; ++rep) {
+            std::uint64_t found = 0;
+            double ms = time_ms([&] {
+                for (auto const &p : probes) found += ads::simd::match(level, &keys[p.first * Capacity], Capacity, p.second) != 0;
+            });
+            sink = found;
+            if (rep >= opt.warmup) results[first].nanos.push_back(ms * 1e6 / n);
+        }
+    }
+}
+
+// ADS_set<Key> lookups with the bucket search capped at every level (-V).
+template <typename Key>
+void run_simd_levels(const char *key, size_t n, const options &opt, std::vector<result> &results) {
+    if (!selected(opt.keys, key)) return;
+    ads::simd::level best = ads::simd::current();
+    for (int l = ads::simd::scalar; l <= best; ++l) {
+        ads::simd::level level = ads::simd::select(static_cast<ads::simd::level>(l));
+        run<ADS_set<Key>, Key>((std::string{"ADS_set<"} + ads::simd::name(level) + ">").c_str(), key, n, opt, results);
+    }
+    ads::simd::select(best);
+}
+
+// Bucket indexes of n random uint64_t keys for a table in the middle of a round (-X):
+// key by key with the branch on nextToSplit as getIndex() had it, key by key without
+// it, and in batches of 16 with the ads::simd kernels of every level. All must agree.
+template <typename Mixer>
+void run_index(const char *mixer, size_t n, const options &opt, std::vector<result> &results) {
+    constexpr size_t batch = 16;
+    std::vector<std::uint64_t> keys(n);
+    for (size_t i = 0; i < n; ++i) keys[i] = key_at<std::uint64_t>(i);
+    size_t seed = static_cast<size_t>(mix64(opt.seed));
+    unsigned round = 1;
+    while ((size_t{2} << round) * 8 <= n) round++;
+    size_t next = (size_t{1} << round) / 2;
+
+    auto branch = [&](size_t &sum) {
+        for (std::uint64_t k : keys) {
+            size_t h = Mixer::mix(std::hash<std::uint64_t>{}(k), seed);
+            size_t index = h & ((size_t{1} << round) - 1);
+            if (index < next) index = h & ((size_t{2} << round) - 1);
+            sum += index;
+        }
+    };
+    auto branchless = [&](size_t &sum) {
+        for (std::uint64_t k : keys) {
+            size_t h = Mixer::mix(std::hash<std::uint64_t>{}(k), seed);
+            size_t index = h & ((size_t{1} << round) - 1);
+            sum += index | (h & (size_t{1} << round) & (0 - static_cast<size_t>(index < next)));
+        }
+    };
+    auto batched = [&](ads::simd::level l, size_t &sum) {
+        size_t h[batch], index[batch];
+        for (size_t i = 0; i < n; i += batch) {
+            size_t m = std::min(batch, n - i);
+            for (size_t j = 0; j < m; ++j) h[j] = std::hash<std::uint64_t>{}(keys[i + j]);
+            size_t j = std::is_same<Mixer, ads::fmix64_mixer>::value ? ads::simd::fmix64_batch(l, h, m, seed) : ads::simd::fibonacci_batch(l, h, m, seed);
+            for (; j < m; ++j) h[j] = Mixer::mix(h[j], seed);
+            j = ads::simd::index_batch(l, h, m, round, next, index);
+            for (; j < m; ++j) index[j] = (h[j] & ((size_t{1} << round) - 1)) | (h[j] & (size_t{1} << round) & (0 - static_cast<size_t>((h[j] & ((size_t{1} << round) - 1)) < next)));
+            for (j = 0; j < m; ++j) sum += index[j];
+        }
+    };
+
+    std::vector<std::string> names = {"branch", "branchless"};
+    for (int l = ads::simd::scalar; l <= ads::simd::supported(); ++l) names.push_back(std::string{"batch<"} + ads::simd::name(static_cast<ads::simd::level>(l)) + ">");
+    size_t first = results.size();
+    for (auto const &name : names) results.push_back(result{name, mixer, n, "index", n, {}});
+    for (size_t rep = 0; rep < opt.warmup + opt.reps; ++rep) {
+        std::vector<size_t> sums(names.size(), 0);
+        std::vector<double> ms(names.size());
+        ms[0] = time_ms([&] { branch(sums[0]); });
+        ms[1] = time_ms([&] { branchless(sums[1]); });
+        for (size_t k = 2; k < names.size(); ++k) ms[k] = time_ms([&] { batched(static_cast<ads::simd::level>(k - 2), sums[k]); });
+        for (size_t k = 1; k < names.size(); ++k) {
+            if (sums[k] != sums[0]) {
+                std::cerr << names[k] << ": indexes differ from the scalar ones\n";
+                std::exit(1);
+            }
+        }
+        sink = sums[0];
+        if (rep < opt.warmup) continue;
+        for (size_t k = 0; k < names.size(); ++k) results[first + k].nanos.push_back(ms[k] * 1e6 / n);
+    }
+}
+
+// ADS_set<Key> filled and queried key by key against insert(first, last) and
+// count(first, last, out), which hash and prefetch in batches (-X).
+template <typename Key>
+void run_batch(const char *key, size_t n, const options &opt, std::vector<result> &results) {
+    std::mt19937_64 gen{opt.seed};
+    std::vector<Key> keys(n), lookups(n);
+    for (size_t i = 0; i < n; ++i) keys[i] = key_at<Key>(i);
+    for (size_t i = 0; i < n; ++i) lookups[i] = gen() % 2 ? keys[gen() % n] : key_at<Key>(n + i);
+    std::vector<unsigned char> counts(n);
+
+    const char *ops[] = {"insert", "insert_range", "count", "count_range"};
+    size_t first = results.size();
+    for (const char *op : ops) results.push_back(result{"ADS_set<N=7>", key, n, op, n, {}});
+    for (size_t rep = 0; rep < opt.warmup + opt.reps; ++rep) {
+        double ms[4];
+        size_t found[2] = {0, 0};
+        {
+            ADS_set<Key> s;
+            ms[0] = time_ms([&] { for (const Key &k : keys) s.insert(k); });
+            ms[2] = time_ms([&] { for (const Key &k : lookups) found[0] += s.count(k); });
+        }
+        ADS_set<Key> s;
+        ms[1] = time_ms([&] { s.insert(keys.begin(), keys.end()); });
+        ms[3] = time_ms([&] { s.count(lookups.begin(), lookups.end(), counts.begin()); });
+        for (unsigned char c : counts) found[1] += c;
+        if (found[0] != found[1] || s.size() != n) {
+            std::cerr << key << ": count(first, last, out) found " << found[1] << " keys instead of " << found[0] << '\n';
+            std::exit(1);
+        }
+        sink = found[0];
+        if (rep < opt.warmup) continue;
+        for (size_t k = 0; k < 4; ++k) results[first + k].nanos.push_back(ms[k] * 1e6 / n);
+    }
+}
+
+template <typename Key, size_t N>
+size_t memory_bytes(const ADS_set<Key, N> &s) {
+    auto st = s.stats();
+    return sizeof(s) + st.directoryBytes + st.bucketBytes;
+}
+
+template <typename Set>
+size_t memory_bytes(const Set &s) {
+    return s.memory_bytes();
+}
+
+// Lookups into a table of n random keys (-I, -H): independent lookups in random order,
+// measuring throughput, and a chain of lookups where each key depends on the previous
+// result, measuring latency. Run with n large enough that the table exceeds the LLC.
+template <typename Set, typename Key = std::uint64_t>
+void run_lookup_latency(const char *container, const char *key, size_t n, const options &opt, std::vector<result> &results) {
+    std::mt19937_64 gen{opt.seed};
+    std::vector<Key> order(n);
+    for (size_t i = 0; i < n; ++i) order[i] = key_at<Key>(gen() % n);
+
+    const char *ops[] = {"count_hit", "count_hit_dependent", "count_miss"};
+    size_t first = results.size();
+    for (const char *op : ops) results.push_back(result{container, key, n, op, n, {}});
+
+    Set s;
+    for (size_t i = 0; i < n; ++i) s.insert(key_at<Key>(i));
+    std::cerr << container << ", n = " << n << ": " << static_cast<double>(memory_bytes(s)) / n << " bytes/element\n";
+
+    for (size_t rep = 0; rep < opt.warmup + opt.reps; ++rep) {
+        double ms[3];
+        size_t found = 0;
+        ms[0] = time_ms([&] { for (const Key &k : order) found += s.count(k); });
+        ms[1] = time_ms([&] {
+            size_t hit = 1;
+            for (size_t j = 1; j <= n; ++j) {
+                hit = s.count(order[j - hit]);                       // hit is always 1, but the next load waits for it
+                found += hit;
+            }
+        });
+        ms[2] = time_ms([&] { for (size_t i = 0; i < n; ++i) found += s.count(key_at<Key>(n + i)); });
+        if (found != 2 * n) {
+            std::cerr << container << ": lookups found " << found << " keys instead of " << 2 * n << '\n';
+            std::exit(1);
+        }
+        sink = found;
+        if (rep < opt.warmup) continue;
+        for (size_t k = 0; k < 3; ++k) results[first + k].nanos.push_back(ms[k] * 1e6 / n);
+    }
+}
+
+// Inverse of ads::fmix64_mixer at seed 0: the keys flood_key(i) all mix to values
+// with 32 zero low bits, i.e. into one chain, unless the table uses another seed.
+std::uint64_t flood_key(std::uint64_t i) {
+    std::uint64_t x = i << 32;
+    x = (x ^ (x >> 33)) * 0x9cb4b2f8129337dbULL;
+    x = (x ^ (x >> 33)) * 0x4f74430c22a54005ULL;
+    return x ^ (x >> 33);
+}
+
+// Hash flooding (-F): keys prepared against a known seed, with and without the reseed
+// defence, and against a table with an unknown seed.
+void run_flood(size_t n, const options &opt, std::vector<result> &results) {
+    using set_t = ADS_set<std::uint64_t, 7, ads::no_instrumentation, ads::fmix64_mixer>;
+    struct { const char *name; bool known_seed; size_t factor; } cases[] = {
+        {"ADS_set<known seed,no defence>", true, 0}, {"ADS_set<known seed,reseed>", true, 8}, {"ADS_set<random seed>", false, 8},
+    };
+    std::vector<std::uint64_t> keys(n);
+    for (size_t i = 0; i < n; ++i) keys[i] = flood_key(i);
+
+    for (auto const &c : cases) {
+        if (c.factor == 0 && n > 100'000) {
+            std::cerr << c.name << ", n = " << n << ": skipped, quadratic\n";
+            continue;
+        }
+        size_t first = results.size();
+        results.push_back(result{c.name, "flood", n, "insert", n, {}});
+        results.push_back(result{c.name, "flood", n, "count_hit", n, {}});
+        for (size_t rep = 0; rep < opt.warmup + opt.reps; ++rep) {
+            set_t s;
+            if (c.known_seed) s.reseed(0);
+            s.max_chain_factor(c.factor);
+            size_t found = 0;
+            double insert = time_ms([&] { for (auto k : keys) s.insert(k); });
+            double count = time_ms([&] { for (auto k : keys) found += s.count(k); });
+            sink = found;
+            if (rep + 1 == opt.warmup + opt.reps) {
+                auto st = s.stats();
+                std::cerr << c.name << ", n = " << n << ": max chain = " << st.maxChainLength << " buckets, reseeds = " << st.reseedCount << '\n';
+            }
+            if (rep < opt.warmup) continue;
+            results[first].nanos.push_back(insert * 1e6 / n);
+            results[first + 1].nanos.push_back(count * 1e6 / n);
+        }
+    }
+}
+
+// Removing every even key (about half) with erase_if, an erase(iterator) loop and by
+// collecting the keys first and erasing them one by one (-E).
+void run_erase_if(size_t n, const options &opt, std::vector<result> &results) {
+    using set_t = ADS_set<std::uint64_t>;
+    auto even = [](std::uint64_t k) { return k % 2 == 0; };
+    std::vector<std::uint64_t> keys(n);
+    for (size_t i = 0; i < n; ++i) keys[i] = key_at<std::uint64_t>(i);
+
+    const char *ops[] = {"erase_if", "erase_iterator_loop", "erase_key_loop"};
+    size_t first = results.size();
+    for (const char *op : ops) results.push_back(result{"ADS_set<N=7>", "u64", n, op, n, {}});
+
+    for (size_t rep = 0; rep < opt.warmup + opt.reps; ++rep) {
+        double ms[3];
+        size_t left[3];
+        for (size_t k = 0; k < 3; ++k) {
+            set_t s(keys.begin(), keys.end());
+            if (k == 0) {
+                ms[k] = time_ms([&] { s.erase_if(even); });
+            } else if (k == 1) {
+                ms[k] = time_ms([&] {
+                    for (auto it = s.begin(); it != s.end(); ) {
+                        if (even(*it)) it = s.erase(it);
+                        else ++it;
+                    }
+                });
+            } else {
+                ms[k] = time_ms([&] {
+                    std::vector<std::uint64_t> doomed;
+                    s.for_each([&](std::uint64_t key) { if (even(key)) doomed.push_back(key); });
+                    for (auto key : doomed) s.erase(key);
+                });
+            }
+            left[k] = s.size();
+        }
+        if (left[0] != left[1] || left[1] != left[2]) {
+            std::cerr << "erase_if: the three methods kept different numbers of keys\n";
+            std::exit(1);
+        }
+        if (rep < opt.warmup) continue;
+        for (size_t k = 0; k < 3; ++k) results[first + k].nanos.push_back(ms[k] * 1e6 / n);
+    }
+}
+
+// One full round of splits on a table of n keys, driven through split() directly,
+// so the directory doubles and every key is rehashed once (-P). Bucket allocations
+// and releases per split go to stderr.
+template <size_t N>
+void run_split(size_t n, const options &opt, std::vector<result> &results) {
+    using set_t = ADS_set<std::uint64_t, N, ads::counting_instrumentation>;
+    std::vector<std::uint64_t> keys(n);
+    for (size_t i = 0; i < n; ++i) keys[i] = key_at<std::uint64_t>(i);
+
+    size_t first = results.size();
+    results.push_back(result{"ADS_set<N=" + std::to_string(N) + ">", "u64", n, "split", 0, {}});
+    results.push_back(result{"ADS_set<N=" + std::to_string(N) + ">", "u64", n, "split_per_key", n, {}});
+    for (size_t rep = 0; rep < opt.warmup + opt.reps; ++rep) {
+        set_t s(keys.begin(), keys.end());
+        size_t splits = s.stats().bucketCount;
+        ads::counting_instrumentation::reset();
+        double ms = time_ms([&] { for (size_t i = 0; i < splits; ++i) s.split(); });
+        if (s.size() != n || s.count(keys[n / 2]) != 1) {
+            std::cerr << "split: keys lost\n";
+            std::exit(1);
+        }
+        if (rep < opt.warmup) continue;
+        results[first].ops = splits;
+        results[first].nanos.push_back(ms * 1e6 / splits);
+        results[first + 1].nanos.push_back(ms * 1e6 / n);
+        if (rep + 1 == opt.warmup + opt.reps) {
+            auto const &c = ads::counting_instrumentation::counters();
+            std::cerr << "split N = " << N << ", n = " << n << ": allocations/split = " << static_cast<double>(c.allocations) / splits
+                      << ", releases/split = " << static_cast<double>(c.releases) / splits << '\n';
+        }
+    }
+}
+
+struct memory_row {
+    std::string scenario;
+    size_t elements;
+    size_t bytes;
+    size_t eager_bytes;                                              // if every directory slot had a bucket
+};
+
+// layout of ADS_set::Bucket: bucketSize, nextBucket, bucket_capacity keys
+template <typename Set>
+constexpr size_t bucket_bytes = sizeof(size_t) + sizeof(void *) + Set::bucket_capacity * sizeof(typename Set::key_type);
+
+template <typename Set>
+memory_row measure(const std::string &scenario, const std::vector<Set> &sets) {
+    memory_row row{scenario, 0, 0, 0};
+    for (const Set &s : sets) {
+        auto st = s.stats();
+        size_t bytes = sizeof(Set) + st.directoryBytes + st.bucketBytes;
+        row.elements += st.size;
+        row.bytes += bytes;
+        row.eager_bytes += bytes + st.chainLengths[0] * bucket_bytes<Set>;
+    }
+    return row;
+}
+
+// Memory of an erase-heavy set and of many small sets (-S).
+void run_memory(size_t n, const options &opt, std::vector<memory_row> &rows) {
+    using set_t = ADS_set<std::uint64_t>;
+    std::mt19937_64 gen{opt.seed};
+    std::vector<set_t> one(1);
+    set_t &s = one[0];
+    for (size_t i = 0; i < n; ++i) s.insert(key_at<std::uint64_t>(i));
+    rows.push_back(measure("filled", one));
+
+    std::vector<std::uint64_t> present;
+    s.for_each([&](std::uint64_t k) { present.push_back(k); });
+    std::shuffle(present.begin(), present.end(), gen);
+    for (size_t i = 0; i < n - n / 10; ++i) s.erase(present[i]);
+    present.erase(present.begin(), present.begin() + (n - n / 10));
+    rows.push_back(measure("erased_90%", one));
+
+    // churn at the reduced size: insert new keys, erase random old ones
+    for (size_t i = 0; i < 10 * n; ++i) {
+        std::uint64_t k = key_at<std::uint64_t>(n + i);
+        s.insert(k);
+        size_t victim = gen() % present.size();
+        s.erase(present[victim]);
+        present[victim] = k;
+    }
+    rows.push_back(measure("churn", one));
+
+    for (size_t k : {0, 1, 2, 4, 8}) {
+        std::vector<set_t> sets(std::max<size_t>(1, n / 100));
+        for (size_t j = 0; j < sets.size(); ++j) {
+            for (size_t i = 0; i < k; ++i) sets[j].insert(key_at<std::uint64_t>(j * k + i));
+        }
+        rows.push_back(measure(std::to_string(sets.size()) + "_sets_of_" + std::to_string(k), sets));
+    }
+}
+
+void write_memory(const std::vector<memory_row> &rows, const std::string &format) {
+    bool json = format == "json";
+    std::cout << (json ? "[" : "scenario,elements,bytes,eager_bytes,bytes_per_element,eager_bytes_per_element\n");
+    for (size_t i = 0; i < rows.size(); ++i) {
+        const memory_row &r = rows[i];
+        double per = r.elements ? static_cast<double>(r.bytes) / r.elements : 0;
+        double eager = r.elements ? static_cast<double>(r.eager_bytes) / r.elements : 0;
+        if (json) {
+            std::cout << (i ? ",\n " : "\n ") << "{\"scenario\": \"" << r.scenario << "\", \"elements\": " << r.elements
+                      << ", \"bytes\": " << r.bytes << ", \"eager_bytes\": " << r.eager_bytes
+                      << ", \"bytes_per_element\": " << per << ", \"eager_bytes_per_element\": " << eager << "}";
+        } else {
+            std::cout << r.scenario << ',' << r.elements << ',' << r.bytes << ',' << r.eager_bytes << ',' << per << ',' << eager << '\n';
+        }
+    }
+    if (json) std::cout << "\n]\n";
+}
+
+struct summary {
+    double median, mean, stddev, min;
+};
+
+summary summarize(std::vector<double> v) {
+    summary s{0, 0, 0, 0};
+    if (v.empty()) return s;
+    std::sort(v.begin(), v.end());
+    size_t k = v.size();
+    s.median = k % 2 ? v[k / 2] : (v[k / 2 - 1] + v[k / 2]) / 2;
+    s.min = v.front();
+    for (double x : v) s.mean += x / k;
+    for (double x : v) s.stddev += (x - s.mean) * (x - s.mean);
+    s.stddev = k > 1 ? std::sqrt(s.stddev / (k - 1)) : 0;
+    return s;
+}
+
+void write_csv(const std::vector<result> &results) {
+    std::cout << "container,key,n,op,reps,median_ns_per_op,mean_ns_per_op,stddev_ns_per_op,min_ns_per_op\n";
+    for (const result &r : results) {
+        summary s = summarize(r.nanos);
+        std::cout << r.container << ',' << r.key << ',' << r.n << ',' << r.op << ',' << r.nanos.size() << ','
+                  << s.median << ',' << s.mean << ',' << s.stddev << ',' << s.min << '\n';
+    }
+}
+
+void write_json(const std::vector<result> &results) {
+    std::cout << "[";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const result &r = results[i];
+        summary s = summarize(r.nanos);
+        std::cout << (i ? ",\n " : "\n ") << "{\"container\": \"" << r.container << "\", \"key\": \"" << r.key
+                  << "\", \"n\": " << r.n << ", \"op\": \"" << r.op << "\", \"reps\": " << r.nanos.size()
+                  << ", \"median_ns_per_op\": " << s.median << ", \"mean_ns_per_op\": " << s.mean
+                  << ", \"stddev_ns_per_op\": " << s.stddev << ", \"min_ns_per_op\": " << s.min << "}";
+    }
+    std::cout << "\n]\n";
+}
+
+int main(int argc, char** argv) {
+    options opt;
+
+    int c;
+    while ((c = getopt(argc, argv, "n:N:r:w:s:k:c:f:MFESPCIHLBVXh")) != -1) {
+        switch (c) {
+            case 'n':
+                opt.min_n = std::atoll(optarg);
+                break;
+            case 'N':
+                opt.max_n = std::atoll(optarg);
+                break;
+            case 'r':
+                opt.reps = std::atoll(optarg);
+                break;
+            case 'w':
+                opt.warmup = std::atoll(optarg);
+                break;
+            case 's':
+                opt.seed = std::atoll(optarg);
+                break;
+            case 'k':
+                opt.keys = optarg;
+                break;
+            case 'c':
+                opt.containers = optarg;
+                break;
+            case 'f':
+                opt.format = optarg;
+                break;
+            case 'M':
+                opt.mixers = true;
+                opt.keys = "sequential,strided,random";
+                break;
+            case 'E':
+                opt.erase = true;
+                break;
+            case 'H':
+                opt.handles = true;
+                break;
+            case 'X':
+                opt.index_batch = true;
+                opt.keys = "int,u64";
+                break;
+            case 'V':
+                opt.vector_kernels = true;
+                opt.keys = "int,u64";
+                break;
+            case 'B':
+                opt.bitwise = true;
+                opt.keys = "int,u64";
+                break;
+            case 'L':
+                opt.cache_lines = true;
+                opt.keys = "int,u64,key16,key32,struct";
+                break;
+            case 'I':
+                opt.inline_buckets = true;
+                break;
+            case 'C':
+                opt.collisions = true;
+                opt.keys = "collide2,collide8,collide40";
+                break;
+            case 'P':
+                opt.split = true;
+                break;
+            case 'S':
+                opt.memory = true;
+                break;
+            case 'F':
+                opt.flood = true;
+                break;
+            case 'h':
+            default:
+                std::cout << "usage: " << argv[0] << " opts\n"
+                          << "  -n $value ... smallest number of keys, default: 1000\n"
+                          << "  -N $value ... largest number of keys (sizes grow tenfold), default: 1000000, e.g. 100000000\n"
+                          << "  -r $value ... measured repetitions, default: 5\n"
+                          << "  -w $value ... warmup repetitions, default: 1\n"
+                          << "  -s $value ... seed for the lookup order and the mixed workload, default: 666\n"
+                          << "  -k $list  ... key types out of int,u64,string,struct, default: all\n"
+                          << "  -c $list  ... containers out of ads1,ads7,ads16,unordered,set, default: all\n"
+                          << "  -f $fmt   ... csv or json, default: csv\n"
+                          << "  -M        ... compare the hash mixers of ADS_set<uint64_t> on sequential,strided,random keys (-k) instead\n"
+                          << "  -E        ... remove half of the keys with erase_if, an erase(iterator) loop and erase(key) instead\n"
+                          << "  -H        ... int lookups and bytes/element, ADS_set vs. ADS_compact_set (32-bit handles), instead\n"
+                          << "  -X        ... bucket index throughput per SIMD level, and ADS_set<int|u64> batched insert/count, instead\n"
+                          << "  -V        ... bucket search kernels per SIMD level (scalar, sse2, avx2, avx512) and ADS_set<int|u64> on each, instead\n"
+                          << "  -B        ... int and u64 on the bitwise key paths vs. the generic ones, including copies, instead\n"
+                          << "  -L        ... N = 7 vs. buckets of 1, 2 and 4 cache lines on int,u64,key16,key32,struct (-k) instead\n"
+                          << "  -I        ... lookup throughput and latency, ADS_set vs. ADS_inline_set, instead\n"
+                          << "  -C        ... chains of 2, 8 and 40 colliding keys at N = 1, linked vs. contiguous overflow instead\n"
+                          << "  -P        ... split throughput and bucket allocations per split for N = 1, 3, 7 instead\n"
+                          << "  -S        ... memory per element after erasing, under churn and for many small sets instead\n"
+                          << "  -F        ... hash flooding: keys colliding under a known seed, with and without reseeding, instead\n"
+                          << "  -h        ... this message\n";
+                std::exit(-1);
+        }
+    }
+    if (opt.min_n == 0 || opt.reps == 0 || (opt.format != "csv" && opt.format != "json")) {
+        std::cerr << "invalid options, see -h\n";
+        return 1;
+    }
+
+    if (opt.memory) {
+        std::vector<memory_row> rows;
+        for (size_t n = opt.min_n; n <= opt.max_n; n *= 10) run_memory(n, opt, rows);
+        write_memory(rows, opt.format);
+        return 0;
+    }
+
+    std::vector<result> results;
+    for (size_t n = opt.min_n; opt.flood && n <= opt.max_n; n *= 10) run_flood(n, opt, results);
+    for (size_t n = opt.min_n; opt.erase && n <= opt.max_n; n *= 10) run_erase_if(n, opt, results);
+    for (size_t n = opt.min_n; opt.inline_buckets && n <= opt.max_n; n *= 10) {
+        run_lookup_latency<ADS_set<std::uint64_t>>("ADS_set<N=7>", "u64", n, opt, results);
+        run_lookup_latency<ADS_inline_set<std::uint64_t>>("ADS_inline_set<N=7>", "u64", n, opt, results);
+        run_lookup_latency<ADS_inline_set<std::uint64_t, 6>>("ADS_inline_set<N=6>", "u64", n, opt, results);
+    }
+    for (size_t n = opt.min_n; opt.handles && n <= opt.max_n; n *= 10) {
+        run_lookup_latency<ADS_set<int, 3>, int>("ADS_set<N=3>", "int", n, opt, results);
+        run_lookup_latency<ADS_compact_set<int, 3>, int>("ADS_compact_set<N=3>", "int", n, opt, results);
+        run_lookup_latency<ADS_set<int, 7>, int>("ADS_set<N=7>", "int", n, opt, results);
+        run_lookup_latency<ADS_compact_set<int, 7>, int>("ADS_compact_set<N=7>", "int", n, opt, results);
+    }
+    for (size_t n = opt.min_n; opt.index_batch && n <= opt.max_n; n *= 10) {
+        std::cerr << "n = " << n << '\n';
+        run_index<ads::fibonacci_mixer>("fibonacci", n, opt, results);
+        run_index<ads::fmix64_mixer>("fmix64", n, opt, results);
+        if (selected(opt.keys, "int")) run_batch<int>("int", n, opt, results);
+        if (selected(opt.keys, "u64")) run_batch<std::uint64_t>("u64", n, opt, results);
+    }
+    for (size_t n = opt.min_n; opt.vector_kernels && n <= opt.max_n; n *= 10) {
+        std::cerr << "n = " << n << ", CPU supports " << ads::simd::name(ads::simd::supported()) << ", using " << ads::simd::name(ads::simd::current()) << '\n';
+        if (selected(opt.keys, "int")) {
+            run_match<int, 8>("int", n, opt, results);
+            run_match<int, 12>("int", n, opt, results);
+            run_match<int, 60>("int", n, opt, results);
+        }
+        if (selected(opt.keys, "u64")) {
+            run_match<std::uint64_t, 8>("u64", n, opt, results);
+            run_match<std::uint64_t, 30>("u64", n, opt, results);
+        }
+        run_simd_levels<int>("int", n, opt, results);
+        run_simd_levels<std::uint64_t>("u64", n, opt, results);
+    }
+    for (size_t n = opt.min_n; opt.bitwise && n <= opt.max_n; n *= 10) {
+        run_bitwise<int>("int", n, opt, results);
+        run_bitwise<std::uint64_t>("u64", n, opt, results);
+    }
+    for (size_t n = opt.min_n; opt.cache_lines && n <= opt.max_n; n *= 10) {
+        run_cache_lines<int>("int", n, opt, results, key_at<int>);
+        run_cache_lines<std::uint64_t>("u64", n, opt, results, key_at<std::uint64_t>);
+        run_cache_lines<sized_key<16>>("key16", n, opt, results, sized_at<16>);
+        run_cache_lines<sized_key<32>>("key32", n, opt, results, sized_at<32>);
+        run_cache_lines<big_key>("struct", n, opt, results, key_at<big_key>);
+    }
+    for (size_t n = opt.min_n; opt.collisions && n <= opt.max_n; n *= 10) {
+        run_collisions<2>(n, opt, results);
+        run_collisions<8>(n, opt, results);
+        run_collisions<40>(n, opt, results);
+    }
+    for (size_t n = opt.min_n; opt.split && n <= opt.max_n; n *= 10) {
+        run_split<1>(n, opt, results);
+        run_split<3>(n, opt, results);
+        run_split<7>(n, opt, results);
+    }
+    for (size_t n = opt.min_n; opt.mixers && n <= opt.max_n; n *= 10) {
+        run_mixer<ads::no_mixer>("ADS_set<mixer=none>", n, opt, results);
+        run_mixer<ads::fibonacci_mixer>("ADS_set<mixer=fibonacci>", n, opt, results);
+        run_mixer<ads::fmix64_mixer>("ADS_set<mixer=fmix64>", n, opt, results);
+    }
+    for (size_t n = opt.min_n; !opt.mixers && !opt.flood && !opt.erase && !opt.split && !opt.collisions && !opt.inline_buckets && !opt.handles && !opt.cache_lines && !opt.bitwise && !opt.vector_kernels && !opt.index_batch && n <= opt.max_n; n *= 10) {
+        run_key<int>("int", n, opt, results);
+        run_key<std::uint64_t>("u64", n, opt, results);
+        run_key<std::string>("string", n, opt, results);
+        run_key<big_key>("struct", n, opt, results);
+    }
+
+    if (opt.format == "json") write_json(results);
+    else write_csv(results);
+}
@@ -12,7 +12,11 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <cstring>
+#include <fstream>
 #include <future>
+#include <iomanip>
 #include <iostream>
 #include <iterator>
 #include <random>
@@ -24,8 +28,13 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
 #include "ADS_set.h"
+#include "ADS_compact_set.h"
+#include "ADS_trace.h"
 
 #if !defined PH1 && !defined PH2
 #define PH2
@@ -128,12 +137,22 @@ namespace std {
 }
 
 namespace ads {
+#if defined INSTRUMENT && defined TRACE
+#error INSTRUMENT and TRACE select different instrumentation policies.
+#elif defined INSTRUMENT
+    using instrumentation = counting_instrumentation;
+#elif defined TRACE
+    using instrumentation = tracing_instrumentation;
+#else
+    using instrumentation = no_instrumentation;
+#endif
+
     template <class T>
     using set =
 #ifdef SIZE
-        ADS_set<T, SIZE>;
+        typename ADS_set<T, SIZE>::template instrumented<instrumentation>;
 #else
-        ADS_set<T>;
+        typename ADS_set<T>::template instrumented<instrumentation>;
 #endif
 }
 
@@ -384,6 +403,194 @@ void test_insert_it_erase(ads::set<val_t>& a, std::set<val_t>& r, size_t n, size
 
     sanity_check("insert_it_erase", a, r);
 }
+
+/* erase(pos) liefert den iterator auf den wert, der bei der traversierung auf pos
+ * gefolgt wäre; die übrigen werte behalten ihre reihenfolge. */
+void test_erase_iter(ads::set<val_t>& a, std::set<val_t>& r, size_t n, RNG& gen) {
+    std::cerr << "\n=== test_erase_iter ===\n";
+
+    for(size_t i = 0; i < n && !a.empty(); ++i) {
+        std::vector<size_t> order;
+        for(auto const& v: a) { order.push_back(v.i); }
+
+        // zuerst immer end()-1, dann zufällige positionen
+        size_t k = i == 0 ? order.size() - 1 : std::uniform_int_distribution<size_t>{ 0, order.size() - 1 }(gen);
+        auto pos = std::next(a.begin(), static_cast<std::ptrdiff_t>(k));
+        val_t v{ order[k] };
+
+        std::cerr << "er it " << v << '\n';
+        auto it_a = a.erase(pos);
+        r.erase(v);
+
+        bool at_end = k + 1 == order.size();
+        if(at_end ? it_a != a.end() : (it_a == a.end() || it_a->i != order[k + 1])) {
+            std::cerr << RED("[erase_iter] err: erasing value " << v << " returned " << it2str(a, it_a) << ", but expected "
+                      << (at_end ? std::string{ "end()" } : std::to_string(order[k + 1])) << '\n');
+
+            dump_compare(a, r);
+            std::abort();
+        }
+
+        std::vector<size_t> rest;
+        for(auto const& w: a) { rest.push_back(w.i); }
+        order.erase(order.begin() + static_cast<std::ptrdiff_t>(k));
+        if(rest != order) {
+            std::cerr << RED("[erase_iter] err: erasing value " << v << " changed the order of the remaining values\n");
+
+            dump_compare(a, r);
+            std::abort();
+        }
+    }
+
+    sanity_check("erase_iter", a, r);
+}
+
+/* for(it = begin(); it != end(); ) it = pred ? erase(it) : ++it; muss jeden wert
+ * genau einmal besuchen. */
+void test_erase_iter_loop(ads::set<val_t>& a, std::set<val_t>& r, size_t max_value, RNG& gen) {
+    std::cerr << "\n=== test_erase_iter_loop ===\n";
+    size_t m = std::uniform_int_distribution<size_t>{ 2, 4 }(gen);
+    std::cerr << "er it all values with v % " << m << " == 0\n";
+
+    std::set<val_t> visited;
+    for(auto it = a.begin(); it != a.end(); ) {
+        if(!visited.insert(*it).second) {
+            std::cerr << RED("[erase_iter_loop] err: value " << *it << " visited twice\n");
+            std::abort();
+        }
+        if(it->i % m == 0) {
+            it = a.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    if(visited != r) {
+        std::cerr << RED("[erase_iter_loop] err: the loop did not visit every value exactly once\n");
+        std::abort();
+    }
+    for(size_t v = 0; v <= max_value; v += m) { r.erase(val_t{ v }); }
+
+    sanity_check("erase_iter_loop", a, r);
+}
+
+/* erase(first, last) über zufällige bereiche der traversierung, die über buckets und
+ * ketten hinweg gehen. */
+void test_erase_range(ads::set<val_t>& a, std::set<val_t>& r, size_t n, RNG& gen) {
+    std::cerr << "\n=== test_erase_range ===\n";
+
+    for(size_t i = 0; i < n / 4 + 1 && !a.empty(); ++i) {
+        std::vector<size_t> order;
+        for(auto const& v: a) { order.push_back(v.i); }
+
+        std::uniform_int_distribution<size_t> dist{ 0, order.size() };
+        size_t f = dist(gen);
+        size_t l = dist(gen);
+        if(f > l) { std::swap(f, l); }
+        if(i == 0) { l = order.size(); }                          // bis end()
+
+        std::cerr << "er [" << f << ", " << l << ")\n";
+        auto first = std::next(a.begin(), static_cast<std::ptrdiff_t>(f));
+        auto last = std::next(a.begin(), static_cast<std::ptrdiff_t>(l));
+        auto it_a = a.erase(first, last);
+        for(size_t k = f; k < l; ++k) { r.erase(val_t{ order[k] }); }
+
+        bool at_end = l == order.size();
+        if(at_end ? it_a != a.end() : (it_a == a.end() || it_a->i != order[l])) {
+            std::cerr << RED("[erase_range] err: erase of [" << f << ", " << l << ") returned " << it2str(a, it_a) << ", but expected "
+                      << (at_end ? std::string{ "end()" } : std::to_string(order[l])) << '\n');
+
+            dump_compare(a, r);
+            std::abort();
+        }
+        sanity_check("erase_range", a, r);
+    }
+}
+
+/* member- und freies erase_if gegen std::set; die rückgabe ist die zahl der gelöschten werte. */
+void test_erase_if(ads::set<val_t>& a, std::set<val_t>& r, RNG& gen) {
+    std::cerr << "\n=== test_erase_if ===\n";
+
+    for(int member = 0; member < 2; ++member) {
+        size_t m = std::uniform_int_distribution<size_t>{ 2, 5 }(gen);
+        size_t x = std::uniform_int_distribution<size_t>{ 0, m - 1 }(gen);
+        auto pred = [m, x](val_t const& v) { return v.i % m == x; };
+        std::cerr << (member ? "a.erase_if" : "erase_if") << " v % " << m << " == " << x << '\n';
+
+        size_t c_r = 0;
+        for(auto it = r.begin(); it != r.end(); ) {
+            if(pred(*it)) {
+                it = r.erase(it);
+                ++c_r;
+            } else {
+                ++it;
+            }
+        }
+        size_t c_a = member ? a.erase_if(pred) : erase_if(a, pred);
+
+        if(c_a != c_r) {
+            std::cerr << RED("[erase_if] err: erase_if returned " << c_a << ", but expected " << c_r << '\n');
+
+            dump_compare(a, r);
+            std::abort();
+        }
+        sanity_check("erase_if", a, r);
+    }
+
+    std::cerr << "erase_if everything\n";
+    size_t c_a = a.erase_if([](val_t const&) { return true; });
+    if(c_a != r.size() || !a.empty() || a.begin() != a.end()) {
+        std::cerr << RED("[erase_if] err: erasing everything returned " << c_a << ", but expected " << r.size() << '\n');
+        std::abort();
+    }
+    r.clear();
+    sanity_check("erase_if", a, r);
+}
+
+/* ganze ketten leeren: ohne mixer liegen die vielfachen von 256 bei kleinen tabellen
+ * alle in der kette von bucket 0, die mit N = 3 aus mehreren buckets besteht. */
+void test_erase_chain() {
+    std::cerr << "\n=== test_erase_chain ===\n";
+    using set_t = ADS_set<val_t, 3, ads::instrumentation, ads::no_mixer>;
+    std::vector<size_t> const others{ 1, 2, 3, 5 };
+
+    for(int how = 0; how < 3; ++how) {
+        set_t a;
+        for(size_t k = 0; k < 12; ++k) { a.insert(val_t{ k << 8 }); }
+        for(size_t v: others) { a.insert(val_t{ v }); }
+        if(a.begin()->i % 256 != 0 || a.stats().maxChainLength < 2) {
+            std::cerr << RED("[erase_chain] err: multiples of 256 are expected in one long chain of bucket 0\n");
+            a.dump();
+            std::abort();
+        }
+
+        size_t removed = 0;
+        if(how == 0) {
+            std::cerr << "er [begin(), begin() + 12)\n";
+            auto it = a.erase(a.begin(), std::next(a.begin(), 12));
+            removed = 12;
+            if(it != a.begin() || it == a.end() || it->i % 256 == 0) {
+                std::cerr << RED("[erase_chain] err: erasing the chain returned " << it2str(a, it) << ", expected the first remaining value\n");
+                std::abort();
+            }
+        } else if(how == 1) {
+            std::cerr << "er it begin() 12 times\n";
+            for(auto it = a.begin(); removed < 12; ++removed) { it = a.erase(it); }
+        } else {
+            std::cerr << "erase_if v % 256 == 0\n";
+            removed = a.erase_if([](val_t const& v) { return v.i % 256 == 0; });
+        }
+
+        std::vector<size_t> rest;
+        for(auto const& v: a) { rest.push_back(v.i); }
+        std::sort(rest.begin(), rest.end());
+        if(removed != 12 || rest != others || a.size() != others.size() || a.count(val_t{ 0 }) || a.stats().chainLengths[0] == 0) {
+            std::cerr << RED("[erase_chain] err: emptying the chain of bucket 0 left a wrong set\n");
+            a.dump();
+            std::abort();
+        }
+    }
+}
 #endif
 
 void test_count(ads::set<val_t> const& a, std::set<val_t> const& r, size_t max_value) {
@@ -969,6 +1176,151 @@ void test_find_iter(ads::set<val_t> const& a, std::set<val_t> const& r) {
     }
 }
 
+/* contiguous_overflow füllt den ersten bucket der kette, der platz hat; nach einem erase
+ * ist das nicht mehr das spill-bucket am ende. alle werte landen in einer kette. */
+void test_contiguous_erase_insert() {
+    std::cerr << "\n=== test_contiguous_erase_insert ===\n";
+    using set_t = ADS_set<val_t, 3, ads::instrumentation, ads::no_mixer, ads::contiguous_overflow>;
+
+    set_t a;
+    for(size_t i = 0; i < 40; ++i) { a.insert(val_t{ i << 8 }); }
+
+    for(size_t i = 0; i < 40; ++i) {
+        val_t v{ i << 8 };
+        std::cerr << "er/in " << v << '\n';
+        a.erase(v);
+        auto it_a = a.insert(v);
+        if(!it_a.second || it_a.first == a.end() || it_a.first->i != v.i) {
+            std::cerr << RED("[contiguous_erase_insert] err: reinserted value " << v << " but iterator points to "
+                      << (it_a.first == a.end() ? std::string{ "end()" } : std::to_string(it_a.first->i)) << '\n');
+            a.dump();
+            std::abort();
+        }
+    }
+
+    if(a.size() != 40) {
+        std::cerr << RED("[contiguous_erase_insert] err: size is " << a.size() << ", expected 40\n");
+        std::abort();
+    }
+}
+
+/* die treffer einer schnittmenge können sich in wenigen buckets häufen (identität als hash,
+ * jeder 16. wert fehlt); das ergebnis braucht trotzdem genug buckets für kurze ketten. */
+void test_clustered_intersection() {
+    std::cerr << "\n=== test_clustered_intersection ===\n";
+    using set_t = ADS_set<val_t, 7, ads::instrumentation, ads::no_mixer>;
+    size_t const n = 65536;
+
+    set_t a;
+    set_t b;
+    for(size_t i = 0; i < n; ++i) {
+        a.insert(val_t{ i });
+        if(i % 16 != 0) { b.insert(val_t{ i }); }
+    }
+
+    set_t i = a.set_intersection(b);
+    auto st = i.stats();
+    std::cerr << "size = " << i.size() << ", buckets = " << st.bucketCount << ", longest chain = " << st.maxChainLength << '\n';
+    if(i.size() != n - n / 16 || i != b) {
+        std::cerr << RED("[clustered_intersection] err: intersection has " << i.size() << " values, expected " << n - n / 16 << '\n');
+        std::abort();
+    }
+    if(st.bucketCount * set_t::bucket_capacity * 2 < i.size() || st.maxChainLength > 4) {
+        std::cerr << RED("[clustered_intersection] err: " << i.size() << " values in " << st.bucketCount
+                  << " buckets, longest chain " << st.maxChainLength << " buckets\n");
+        std::abort();
+    }
+}
+
+/* gleiche bytes wie val_t, aber ein anderer hash: steht für eine tabelle, die mit
+ * einem anderen std::hash geschrieben wurde. */
+struct flipped_t: val_t {
+    using val_t::val_t;
+};
+
+bool operator==(flipped_t const& lhs, flipped_t const& rhs) { return std::equal_to<val_t>{}(lhs, rhs); }
+
+namespace std {
+    template <>
+    struct hash<flipped_t> {
+        size_t operator()(flipped_t const& v) const { return ~std::hash<val_t>{}(v); }
+    };
+}
+
+/* deserialize() darf einer fremden eingabe nicht glauben: anderer mixer, anderer
+ * hash, zu großer kopf, abgeschnittene daten, verdrehte ketten. */
+void test_deserialize_checks() {
+    std::cerr << "\n=== test_deserialize_checks ===\n";
+    using plain_t = ADS_set<val_t, 7, ads::instrumentation, ads::no_mixer>;
+    using mixed_t = ADS_set<val_t, 7, ads::instrumentation, ads::fibonacci_mixer>;
+
+    plain_t a;
+    for(size_t i = 0; i < 1000; ++i) { a.insert(val_t{ i }); }
+    std::vector<char> buf;
+    a.serialize(buf);
+
+    auto rejects = [](auto& set, std::vector<char> const& data) {
+        try {
+            set.deserialize(data.data(), data.size());
+        } catch(std::runtime_error const& e) {
+            std::cerr << "rejected: " << e.what() << '\n';
+            return true;
+        }
+        return false;
+    };
+
+    mixed_t m;
+    plain_t p;
+    std::vector<char> huge_round{ buf };
+    uint64_t round = 31;
+    std::memcpy(huge_round.data() + 3 * sizeof(uint64_t), &round, sizeof(round));    // magic, key size, size, round
+    std::vector<char> cut{ buf.begin(), buf.end() - 1 };
+
+    ADS_set<flipped_t, 7, ads::instrumentation, ads::no_mixer> f;
+
+    if(!rejects(m, buf) || !rejects(f, buf) || !rejects(p, huge_round) || !rejects(p, cut) || !p.empty()) {
+        std::cerr << RED("[deserialize_checks] err: accepted a table written by another mixer or hash, with a bad header or cut short\n");
+        std::abort();
+    }
+    p.deserialize(buf.data(), buf.size());
+    if(p != a) {
+        std::cerr << RED("[deserialize_checks] err: deserialized set differs from the original\n");
+        std::abort();
+    }
+
+    // ADS_compact_set schreibt verzeichnis und bucket-pool so, wie sie im speicher liegen
+    ADS_compact_set<val_t, 7, ads::no_mixer> c;
+    for(size_t i = 0; i < 1000; ++i) { c.insert(val_t{ i }); }
+    std::ostringstream out;
+    c.serialize(out);
+    std::string const cbuf = out.str();
+
+    auto rejects_stream = [](auto& set, std::string const& data) {
+        std::istringstream in{ data };
+        try {
+            set.deserialize(in);
+        } catch(std::runtime_error const& e) {
+            std::cerr << "rejected: " << e.what() << '\n';
+            return true;
+        }
+        return false;
+    };
+
+    ADS_compact_set<val_t, 7, ads::fibonacci_mixer> cm;
+    ADS_compact_set<flipped_t, 7, ads::no_mixer> cf;
+    ADS_compact_set<val_t, 7, ads::no_mixer> cp;
+    if(!rejects_stream(cm, cbuf) || !rejects_stream(cf, cbuf) || !rejects_stream(cp, cbuf.substr(0, cbuf.size() - 1)) || !cp.empty()) {
+        std::cerr << RED("[deserialize_checks] err: ADS_compact_set accepted a table written by another mixer or hash, or cut short\n");
+        std::abort();
+    }
+    std::istringstream in{ cbuf };
+    cp.deserialize(in);
+    if(cp != c) {
+        std::cerr << RED("[deserialize_checks] err: deserialized ADS_compact_set differs from the original\n");
+        std::abort();
+    }
+}
+
 void test_swap_insert_erase(ads::set<val_t>& a1, std::set<val_t>& r1, ads::set<val_t>& a2, std::set<val_t>& r2, size_t n, size_t max_value, RNG& gen) {
     std::cerr << "\n=== test_swap_insert_erase ===\n";
     using std::swap; // wäh, igitt
@@ -1158,6 +1510,30 @@ void test_all_ph2(size_t n, size_t max_value, RNG& gen) {
         test_empty(a, r);
     }
 
+    {
+        std::cerr << "\n----\n";
+        ads::set<val_t> a;
+        std::set<val_t> r;
+
+        test_insert_it(a, r, n, max_value, gen);
+        test_erase_iter(a, r, n, gen);
+        test_iter(a, r);
+
+        test_insert_it(a, r, n, max_value, gen);
+        test_erase_iter_loop(a, r, max_value, gen);
+        test_iter(a, r);
+
+        test_insert_it(a, r, n, max_value, gen);
+        test_erase_range(a, r, n, gen);
+        test_iter(a, r);
+
+        test_insert_it(a, r, n, max_value, gen);
+        test_erase_if(a, r, gen);
+        test_insert_erase(a, r, n, max_value, gen);
+        test_count(a, r, max_value);
+        test_find(a, r, max_value);
+    }
+
     {
         std::cerr << "\n----\n";
         ads::set<val_t> a;
@@ -1265,8 +1641,31 @@ void test_all_ph2(size_t n, size_t max_value, RNG& gen) {
 }
 #endif
 
+/* mit -D INSTRUMENT zählt ads::set seine arbeit mit; jede phase der stresstests
+ * gibt dann vergleiche, überlauf-sprünge, ... pro operation aus. */
+void reset_instrumentation() {
+#ifdef INSTRUMENT
+    ads::counting_instrumentation::reset();
+#endif
+}
+
+void report_instrumentation(char const* phase, size_t ops) {
+#ifdef INSTRUMENT
+    auto const& c = ads::counting_instrumentation::counters();
+    std::cerr << "  " << phase << ": probes/op = " << static_cast<double>(c.probes) / ops
+              << ", comparisons/op = " << static_cast<double>(c.comparisons) / ops
+              << ", hops/op = " << static_cast<double>(c.hops) / ops
+              << ", splits = " << c.splits << ", allocations = " << c.allocations << ", frees = " << c.releases << '\n';
+    ads::counting_instrumentation::reset();
+#else
+    (void)phase;
+    (void)ops;
+#endif
+}
+
 void do_stresstest1(RNG* const gen) {
     std::cerr << "\n=== stresstest1 " << (gen ? "(randomized) " : "") << "===\n";
+    reset_instrumentation();
 
     size_t const n = 1'000'000;
     std::vector<val_t> vs(n);
@@ -1291,6 +1690,7 @@ void do_stresstest1(RNG* const gen) {
     }
 
     std::cerr << "elapsed_insert = " << elapsed_insert << " ms\n";
+    report_instrumentation("insert", n);
     if(gen) { std::shuffle(vs.begin(), vs.end(), *gen); }
 
     double elapsed_count;
@@ -1308,11 +1708,13 @@ void do_stresstest1(RNG* const gen) {
     }
 
     std::cerr << "elapsed_count  = " << elapsed_count  << " ms\n";
+    report_instrumentation("count", n);
 }
 
 #ifdef PH2
 void do_stresstest2(RNG* const gen) {
     std::cerr << "\n=== stresstest2 " << (gen ? "(randomized) " : "") << "===\n";
+    reset_instrumentation();
 
     size_t const n = 1'000'000;
     std::vector<val_t> vs(n);
@@ -1342,6 +1744,7 @@ void do_stresstest2(RNG* const gen) {
     }
 
     std::cerr << "elapsed_insert = " << elapsed_insert << " ms\n";
+    report_instrumentation("insert", n);
     if(gen) { std::shuffle(vs.begin(), vs.end(), *gen); }
 
     double elapsed_count;
@@ -1359,6 +1762,7 @@ void do_stresstest2(RNG* const gen) {
     }
 
     std::cerr << "elapsed_count  = " << elapsed_count  << " ms\n";
+    report_instrumentation("count", n);
     if(gen) { std::shuffle(vs.begin(), vs.end(), *gen); }
 
     double elapsed_find;
@@ -1376,6 +1780,7 @@ void do_stresstest2(RNG* const gen) {
     }
 
     std::cerr << "elapsed_find   = " << elapsed_find  << " ms\n";
+    report_instrumentation("find", n);
 
     if(!gen) {
         double elapsed_iter;
@@ -1400,8 +1805,36 @@ void do_stresstest2(RNG* const gen) {
             std::abort();
         }
         std::cerr << "elapsed_iter   = " << elapsed_iter << " ms\n";
+        report_instrumentation("iter+find", n);
     }
 
+    double elapsed_iter_scan;
+    size_t sum_iter = 0;
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        for(auto it = a.begin(); it != a.end(); ++it) { sum_iter += it->i; }
+        auto end = std::chrono::high_resolution_clock::now();
+
+        elapsed_iter_scan = std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    double elapsed_scan;
+    size_t sum_scan = 0;
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        a.for_each([&sum_scan](val_t const& v) { sum_scan += v.i; });
+        auto end = std::chrono::high_resolution_clock::now();
+
+        elapsed_scan = std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    if(sum_iter != sum_scan || sum_scan != n * (n - 1) / 2) {
+        std::cerr << RED("[stresstest2] err: for_each visited different values than the iterator loop\n");
+        std::abort();
+    }
+    std::cerr << "elapsed_iter_scan = " << elapsed_iter_scan << " ms\n";
+    std::cerr << "elapsed_scan      = " << elapsed_scan << " ms\n";
+
     if(gen) { std::shuffle(vs.begin(), vs.end(), *gen); }
 
     double elapsed_erase;
@@ -1424,9 +1857,421 @@ void do_stresstest2(RNG* const gen) {
     }
 
     std::cerr << "elapsed_erase  = " << elapsed_erase  << " ms\n";
+    report_instrumentation("erase", n);
+}
+
+void do_parallelscantest(size_t const n) {
+    std::cerr << "\n=== parallelscantest n = " << n << " ===\n";
+
+    ads::set<val_t> a;
+    for(size_t i = 0; i < n; ++i) { a.insert(val_t{ i }); }
+
+    unsigned const max_threads = std::max(4u, std::thread::hardware_concurrency());
+    for(unsigned threads = 1; threads <= max_threads; threads *= 2) {
+        std::atomic<size_t> hits{ 0 };
+        auto start = std::chrono::high_resolution_clock::now();
+        a.parallel_for_each([&hits](val_t const& v) {
+            if(v.i % 64 == 0) { hits.fetch_add(1, std::memory_order_relaxed); }
+        }, threads);
+        auto end = std::chrono::high_resolution_clock::now();
+
+        if(hits != (n + 63) / 64) {
+            std::cerr << RED("[parallelscantest] err: scan with " << threads << " threads saw " << hits << " matching values\n");
+            std::abort();
+        }
+
+        double elapsed_scan = std::chrono::duration<double, std::milli>(end - start).count();
+        std::cerr << "threads = " << threads << ": elapsed_scan = " << elapsed_scan << " ms, "
+                  << n / elapsed_scan / 1000 << " M keys/s\n";
+    }
+}
+
+void do_setalgebratest(size_t const n) {
+    std::cerr << "\n=== setalgebratest n = " << n << " (half of the values shared) ===\n";
+
+    ads::set<val_t> a;
+    ads::set<val_t> b;
+    for(size_t i = 0; i < n; ++i) {
+        a.insert(val_t{ i });
+        b.insert(val_t{ i + n / 2 });
+    }
+
+    auto time = [](auto&& f) {
+        auto start = std::chrono::high_resolution_clock::now();
+        f();
+        auto end = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration<double, std::milli>(end - start).count();
+    };
+
+    size_t naive_size = 0;
+    double elapsed_naive_size = time([&] { for(auto const& v: a) { naive_size += b.count(v); } });
+    size_t size = 0;
+    double elapsed_size = time([&] { size = a.intersection_size(b); });
+
+    ads::set<val_t> naive_i;
+    double elapsed_naive_intersection = time([&] { for(auto const& v: a) { if(b.count(v)) { naive_i.insert(v); } } });
+    ads::set<val_t> i;
+    double elapsed_intersection = time([&] { auto r = a.set_intersection(b); i.swap(r); });
+
+    ads::set<val_t> naive_d;
+    double elapsed_naive_difference = time([&] { for(auto const& v: a) { if(!b.count(v)) { naive_d.insert(v); } } });
+    ads::set<val_t> d;
+    double elapsed_difference = time([&] { auto r = a.set_difference(b); d.swap(r); });
+
+    ads::set<val_t> naive_u;
+    double elapsed_naive_union = time([&] { for(auto const& v: a) { naive_u.insert(v); } for(auto const& v: b) { naive_u.insert(v); } });
+    ads::set<val_t> u;
+    double elapsed_union = time([&] { auto r = a.set_union(b); u.swap(r); });
+
+    if(size != naive_size || size != n - n / 2 || i != naive_i || d != naive_d || u != naive_u) {
+        std::cerr << RED("[setalgebratest] err: set algebra result differs from iterate-and-count result\n");
+        std::abort();
+    }
+
+    std::cerr << "elapsed_naive_size         = " << elapsed_naive_size << " ms\n";
+    std::cerr << "elapsed_size               = " << elapsed_size << " ms\n";
+    std::cerr << "elapsed_naive_intersection = " << elapsed_naive_intersection << " ms\n";
+    std::cerr << "elapsed_intersection       = " << elapsed_intersection << " ms\n";
+    std::cerr << "elapsed_naive_difference   = " << elapsed_naive_difference << " ms\n";
+    std::cerr << "elapsed_difference         = " << elapsed_difference << " ms\n";
+    std::cerr << "elapsed_naive_union        = " << elapsed_naive_union << " ms\n";
+    std::cerr << "elapsed_union              = " << elapsed_union << " ms\n";
+
+    unsigned const max_threads = std::max(4u, std::thread::hardware_concurrency());
+    for(unsigned threads = 2; threads <= max_threads; threads *= 2) {
+        double elapsed = time([&] { size = a.intersection_size(b, threads); });
+        if(size != naive_size) {
+            std::cerr << RED("[setalgebratest] err: parallel intersection_size differs\n");
+            std::abort();
+        }
+        std::cerr << "elapsed_size (" << threads << " threads) = " << elapsed << " ms\n";
+
+        elapsed = time([&] { auto r = a.set_union(b, threads); u.swap(r); });
+        if(u != naive_u) {
+            std::cerr << RED("[setalgebratest] err: parallel set_union differs\n");
+            std::abort();
+        }
+        std::cerr << "elapsed_union (" << threads << " threads) = " << elapsed << " ms\n";
+    }
+}
+
+void do_equalitytest(size_t const n, RNG& gen) {
+    std::cerr << "\n=== equalitytest n = " << n << " ===\n";
+
+    std::vector<val_t> vs(n);
+    std::iota(vs.begin(), vs.end(), 0);
+    std::shuffle(vs.begin(), vs.end(), gen);
+
+    ads::set<val_t> a(vs.begin(), vs.end());
+    ads::set<val_t> same{ a };
+    std::shuffle(vs.begin(), vs.end(), gen);
+    ads::set<val_t> shuffled(vs.begin(), vs.end());
+    for(size_t i = 0; i < n / 10; ++i) { shuffled.insert(val_t{ n + i }); }
+    for(size_t i = 0; i < n / 10; ++i) { shuffled.erase(val_t{ n + i }); }
+    ads::set<val_t> nearly{ a };
+    nearly.erase(vs.back());
+    nearly.insert(val_t{ n });
+
+    auto naive_equal = [](ads::set<val_t> const& lhs, ads::set<val_t> const& rhs) {
+        if(lhs.size() != rhs.size()) { return false; }
+        for(auto const& v: lhs) {
+            if(!rhs.count(v)) { return false; }
+        }
+        return true;
+    };
+
+    auto time = [](auto&& f) {
+        auto start = std::chrono::high_resolution_clock::now();
+        bool result = f();
+        auto end = std::chrono::high_resolution_clock::now();
+        return std::make_pair(result, std::chrono::duration<double, std::milli>(end - start).count());
+    };
+
+    struct { char const* name; ads::set<val_t> const& b; bool expected; } cases[] = {
+        { "equal, same geometry     ", same, true },
+        { "equal, other geometry    ", shuffled, true },
+        { "one key differs          ", nearly, false },
+    };
+    for(auto const& c: cases) {
+        auto naive = time([&] { return naive_equal(a, c.b); });
+        auto fast = time([&] { return a == c.b; });
+        if(naive.first != c.expected || fast.first != c.expected) {
+            std::cerr << RED("[equalitytest] err: wrong result for case \"" << c.name << "\"\n");
+            std::abort();
+        }
+        std::cerr << c.name << ": elapsed_naive = " << naive.second << " ms, elapsed_equal = " << fast.second << " ms\n";
+    }
+}
+
+void do_serializetest(size_t const n) {
+    std::cerr << "\n=== serializetest n = " << n << " ===\n";
+
+    ads::set<val_t> a;
+    for(size_t i = 0; i < n; ++i) { a.insert(val_t{ i * 2654435761u }); }
+
+    double elapsed_iter_save;
+    std::vector<val_t> keys;
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        keys.reserve(a.size());
+        for(auto const& v: a) { keys.push_back(v); }
+        auto end = std::chrono::high_resolution_clock::now();
+
+        elapsed_iter_save = std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    double elapsed_iter_load;
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        ads::set<val_t> b;
+        for(auto const& v: keys) { b.insert(v); }
+        auto end = std::chrono::high_resolution_clock::now();
+
+        elapsed_iter_load = std::chrono::duration<double, std::milli>(end - start).count();
+        if(b.size() != n) {
+            std::cerr << RED("[serializetest] err: iterate-and-insert copy has wrong size\n");
+            std::abort();
+        }
+    }
+
+    double elapsed_save;
+    std::vector<char> buf;
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        a.serialize(buf);
+        auto end = std::chrono::high_resolution_clock::now();
+
+        elapsed_save = std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    double elapsed_load;
+    ads::set<val_t> c;
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        c.deserialize(buf.data(), buf.size());
+        auto end = std::chrono::high_resolution_clock::now();
+
+        elapsed_load = std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    if(c != a) {
+        std::cerr << RED("[serializetest] err: deserialized set differs from the original\n");
+        std::abort();
+    }
+
+    std::cerr << "elapsed_iter_save = " << elapsed_iter_save << " ms\n";
+    std::cerr << "elapsed_iter_load = " << elapsed_iter_load << " ms\n";
+    std::cerr << "elapsed_save      = " << elapsed_save << " ms (" << buf.size() / (1024 * 1024) << " MiB)\n";
+    std::cerr << "elapsed_load      = " << elapsed_load << " ms\n";
+}
+
+/* HDR-artiges log-lineares histogramm: 32 unterteilungen je zweierpotenz,
+ * also höchstens ~3% relativer fehler bei beliebig großen werten. */
+class latency_histogram {
+    static constexpr unsigned sub_bits = 5;
+    static constexpr uint64_t sub_count = uint64_t{1} << sub_bits;
+    std::array<uint64_t, (64 - sub_bits + 1) * sub_count> counts{};
+    uint64_t total = 0;
+    uint64_t max_value = 0;
+
+    static size_t index_of(uint64_t v) {
+        if(v < sub_count) { return v; }
+        unsigned shift = 63 - __builtin_clzll(v) - sub_bits;
+        return (shift + 1) * sub_count + ((v >> shift) - sub_count);
+    }
+    static uint64_t value_of(size_t i) {
+        if(i < sub_count) { return i; }
+        unsigned shift = i / sub_count - 1;
+        return (sub_count + i % sub_count) << shift;
+    }
+public:
+    void record(uint64_t v) {
+        ++counts[index_of(v)];
+        ++total;
+        max_value = std::max(max_value, v);
+    }
+    uint64_t max() const { return max_value; }
+    uint64_t count() const { return total; }
+    // kleinster wert, unter dem (inklusive seines buckets) der anteil q der messungen liegt
+    uint64_t percentile(double q) const {
+        uint64_t rank = static_cast<uint64_t>(q * total + 0.5);
+        uint64_t seen = 0;
+        for(size_t i = 0; i < counts.size(); ++i) {
+            seen += counts[i];
+            if(seen >= rank && seen) { return std::min(max_value, value_of(i + 1) - 1); }
+        }
+        return max_value;
+    }
+};
+
+/* zeitstempel einzelner operationen: rdtsc wo vorhanden, sonst steady_clock. */
+inline uint64_t ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+double ns_per_tick() {
+#if defined(__x86_64__) || defined(__i386__)
+    auto start = std::chrono::steady_clock::now();
+    uint64_t t0 = ticks();
+    while(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(50)) {}
+    uint64_t t1 = ticks();
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / (t1 - t0);
+#else
+    return 1;
+#endif
+}
+
+/* merkt sich, bei welcher operation runden wechseln und das verzeichnis wächst. */
+struct round_marker: ads::no_instrumentation {
+    static size_t& op() { thread_local size_t i = 0; return i; }
+    static std::vector<size_t>& rounds() { thread_local std::vector<size_t> v; return v; }
+    static std::vector<size_t>& growths() { thread_local std::vector<size_t> v; return v; }
+
+    static void round_advance(size_t, size_t) { rounds().push_back(op()); }
+    static void grow_end(size_t, size_t) { growths().push_back(op()); }
+};
+
+void do_latencytest(size_t const n, RNG& gen) {
+    std::cerr << "\n=== latencytest n = " << n << " ===\n";
+    using set_t = typename ads::set<val_t>::template instrumented<round_marker>;
+
+    std::vector<val_t> vs(n);
+    std::iota(vs.begin(), vs.end(), 0);
+    std::shuffle(vs.begin(), vs.end(), gen);
+
+    double const scale = ns_per_tick();
+    round_marker::rounds().clear();
+    round_marker::growths().clear();
+
+    set_t a;
+    std::vector<uint64_t> insert_ticks(n);
+    latency_histogram h_insert, h_count, h_find, h_erase;
+
+    for(size_t i = 0; i < n; ++i) {
+        round_marker::op() = i;
+        uint64_t t0 = ticks();
+        bool inserted = a.insert(vs[i]).second;
+        uint64_t t1 = ticks();
+        if(!inserted) {
+            std::cerr << RED("[latencytest] err: returned wrong insertion status (false) for value " << vs[i] << '\n');
+            std::abort();
+        }
+        insert_ticks[i] = t1 - t0;
+        h_insert.record(static_cast<uint64_t>((t1 - t0) * scale));
+    }
+
+    std::shuffle(vs.begin(), vs.end(), gen);
+    for(auto const& v: vs) {
+        uint64_t t0 = ticks();
+        size_t found = a.count(v);
+        uint64_t t1 = ticks();
+        if(!found) {
+            std::cerr << RED("[latencytest] err: missing value " << v << '\n');
+            std::abort();
+        }
+        h_count.record(static_cast<uint64_t>((t1 - t0) * scale));
+    }
+
+    std::shuffle(vs.begin(), vs.end(), gen);
+    for(auto const& v: vs) {
+        uint64_t t0 = ticks();
+        bool found = a.find(v) != a.end();
+        uint64_t t1 = ticks();
+        if(!found) {
+            std::cerr << RED("[latencytest] err: missing value " << v << '\n');
+            std::abort();
+        }
+        h_find.record(static_cast<uint64_t>((t1 - t0) * scale));
+    }
+
+    std::shuffle(vs.begin(), vs.end(), gen);
+    for(auto const& v: vs) {
+        uint64_t t0 = ticks();
+        size_t erased = a.erase(v);
+        uint64_t t1 = ticks();
+        if(!erased) {
+            std::cerr << RED("[latencytest] err: couldn't erase element " << v << '\n');
+            std::abort();
+        }
+        h_erase.record(static_cast<uint64_t>((t1 - t0) * scale));
+    }
+
+    std::cerr << "op          p50      p90      p99     p999        max   (ns)\n";
+    for(auto const& p: { std::make_pair("insert", &h_insert), std::make_pair("count ", &h_count),
+                         std::make_pair("find  ", &h_find), std::make_pair("erase ", &h_erase) }) {
+        auto const& h = *p.second;
+        std::cerr << p.first << std::setw(9) << h.percentile(.5) << std::setw(9) << h.percentile(.9)
+                  << std::setw(9) << h.percentile(.99) << std::setw(9) << h.percentile(.999) << std::setw(11) << h.max() << '\n';
+    }
+
+    // insert-ausreißer (> p999) relativ zu den rundengrenzen
+    auto const& rounds = round_marker::rounds();
+    auto const& growths = round_marker::growths();
+    uint64_t const threshold = static_cast<uint64_t>(h_insert.percentile(.999) / scale);
+    size_t outliers = 0, at_growth = 0;
+    for(size_t i = 0; i < n; ++i) {
+        if(insert_ticks[i] <= threshold) { continue; }
+        ++outliers;
+        at_growth += std::binary_search(growths.begin(), growths.end(), i);
+    }
+    std::cerr << "\ninsert outliers > p999: " << outliers << ", " << at_growth << " of them grew the directory ("
+              << growths.size() << " growths, " << rounds.size() << " round changes)\n";
+
+    std::cerr << "\nround  first op   ops   p50 (ns)  max (ns)  outliers  worst op (ns, position in round)\n";
+    for(size_t r = 0; r <= rounds.size(); ++r) {
+        size_t first = r ? rounds[r - 1] + 1 : 0;
+        size_t last = r < rounds.size() ? rounds[r] + 1 : n;
+        if(first >= last) { continue; }
+        latency_histogram h;
+        size_t worst = first, count = 0;
+        for(size_t i = first; i < last; ++i) {
+            h.record(insert_ticks[i]);
+            count += insert_ticks[i] > threshold;
+            if(insert_ticks[i] > insert_ticks[worst]) { worst = i; }
+        }
+        std::cerr << std::setw(5) << r << std::setw(10) << first << std::setw(9) << last - first
+                  << std::setw(10) << static_cast<uint64_t>(h.percentile(.5) * scale) << std::setw(10) << static_cast<uint64_t>(h.max() * scale)
+                  << std::setw(10) << count << "  #" << worst << " (" << static_cast<uint64_t>(insert_ticks[worst] * scale) << ", "
+                  << 100 * (worst - first) / (last - first) << "%"
+                  << (std::binary_search(growths.begin(), growths.end(), worst) ? ", directory growth" : "") << ")\n";
+    }
 }
 #endif
 
+/* mit -D TRACE zeichnet ads::set splits, verzeichniswachstum, rundenwechsel und
+ * neue überlaufbuckets auf; -T $path schreibt sie als chrome trace-event json. */
+void write_trace(std::string const& path) {
+#ifdef TRACE
+    auto const& t = ads::trace_buffer::instance();
+    /* jedes verzeichniswachstum liegt im split desselben threads, der es ausgelöst hat */
+    for(size_t i = 0; i < t.size(); ++i) {
+        auto const& g = t[i];
+        if(g.kind != ads::trace_buffer::directory_growth) { continue; }
+        size_t j = i + 1;
+        while(j < t.size() && (t[j].kind != ads::trace_buffer::split || t[j].thread != g.thread)) { ++j; }
+        if(j == t.size()) { continue; }
+        if(t[j].start > g.start || t[j].start + t[j].duration < g.start + g.duration) {
+            std::cerr << RED("[trace] err: directory growth at " << g.start << "ns is not nested in its split\n");
+            std::abort();
+        }
+    }
+    std::ofstream o{path};
+    t.write_chrome_trace(o);
+    if(!o) {
+        std::cerr << RED("[trace] err: couldn't write " << path << '\n');
+        std::abort();
+    }
+    std::cerr << "\ntrace: " << t.size() << " events (" << t.overwritten() << " overwritten) written to " << path << '\n';
+#else
+    std::cerr << YELLOW("\n[trace] -T ignored, compile with -D TRACE to record a trace.\n");
+    (void)path;
+#endif
+}
+
 /* zeit möglicherweise zu knapp bemessen für container mit pervers
  * kleinem default N. (-D SIZE) */
 void stresstest(RNG* const gen = nullptr) {
@@ -1503,9 +2348,15 @@ int main(int argc, char** argv) {
 
     bool only_benchmark = false;
     bool no_benchmark = false;
+    size_t serialize_n = 0;
+    size_t parallel_n = 0;
+    size_t algebra_n = 0;
+    size_t equality_n = 0;
+    size_t latency_n = 0;
+    std::string trace_path;
 
     int c;
-    while((c = getopt(argc, argv, "n:m:o:v:w:x:s:t:bBh")) != -1) {
+    while((c = getopt(argc, argv, "n:m:o:v:w:x:s:t:l:P:A:E:L:T:bBh")) != -1) {
         switch(c) {
             case 'n':
                 n = std::atoll(optarg);
@@ -1539,6 +2390,30 @@ int main(int argc, char** argv) {
                 t = std::atoll(optarg);
                 std::cout << "t = " << t << '\n';
                 break;
+            case 'l':
+                serialize_n = std::atoll(optarg);
+                std::cout << "serialize benchmark with " << serialize_n << " values\n";
+                break;
+            case 'P':
+                parallel_n = std::atoll(optarg);
+                std::cout << "parallel scan benchmark with " << parallel_n << " values\n";
+                break;
+            case 'A':
+                algebra_n = std::atoll(optarg);
+                std::cout << "set algebra benchmark with " << algebra_n << " values\n";
+                break;
+            case 'E':
+                equality_n = std::atoll(optarg);
+                std::cout << "equality benchmark with " << equality_n << " values\n";
+                break;
+            case 'L':
+                latency_n = std::atoll(optarg);
+                std::cout << "latency benchmark with " << latency_n << " values\n";
+                break;
+            case 'T':
+                trace_path = optarg;
+                std::cout << "trace to " << trace_path << '\n';
+                break;
             case 'b':
                 only_benchmark = true;
                 std::cout << "benchmark only\n";
@@ -1561,6 +2436,12 @@ int main(int argc, char** argv) {
                           << "  -s $value ... first seed, default: " << S << '\n'
                           << "  -t $value ... number of seeds (will be drawn from rng w/ previous seed), default: " << T << '\n'
                           << "                will do the full test suite t times!\n"
+                          << "  -l $value ... only do the save/load benchmark with $value values (e.g. 10000000)\n"
+                          << "  -P $value ... only do the parallel scan benchmark with $value values (e.g. 100000000)\n"
+                          << "  -A $value ... only do the set algebra benchmark with two sets of $value values (e.g. 10000000)\n"
+                          << "  -E $value ... only do the operator== benchmark with sets of $value values (e.g. 10000000)\n"
+                          << "  -L $value ... only do the per-operation latency benchmark with $value values (e.g. 10000000)\n"
+                          << "  -T $path  ... write the splits etc. of the benchmark as chrome trace-event json (needs -D TRACE)\n"
                           << "  -b        ... only do benchmark\n"
                           << "  -B        ... don't do benchmark\n"
                           << "  -h        ... this message\n\n"
@@ -1572,9 +2453,40 @@ int main(int argc, char** argv) {
     }
 
     std::mt19937_64 gen{ s };
+#ifdef PH2
+    if(serialize_n) {
+        do_serializetest(serialize_n);
+
+        return 0;
+    }
+    if(parallel_n) {
+        do_parallelscantest(parallel_n);
+
+        return 0;
+    }
+    if(algebra_n) {
+        do_setalgebratest(algebra_n);
+
+        return 0;
+    }
+    if(equality_n) {
+        do_equalitytest(equality_n, gen);
+
+        return 0;
+    }
+    if(latency_n) {
+        do_latencytest(latency_n, gen);
+
+        return 0;
+    }
+#endif
     if(only_benchmark) {
+#ifdef TRACE
+        ads::trace_buffer::instance().clear();
+#endif
         stresstest();
         stresstest(&gen);
+        if(!trace_path.empty()) { write_trace(trace_path); }
 
         return 0;
     }
@@ -1584,6 +2496,12 @@ int main(int argc, char** argv) {
 
     test_initlist_constructor2();
     test_range_constructor2();
+#ifdef PH2
+    test_contiguous_erase_insert();
+    test_clustered_intersection();
+    test_deserialize_checks();
+    test_erase_chain();
+#endif
 
     for(size_t i = 0; i < t; ++i) {
         for(size_t n_ = n; n_ <= o; n_ += m) {
@@ -1604,8 +2522,12 @@ int main(int argc, char** argv) {
     }
 
     if(no_benchmark) { return 0; }
+#ifdef TRACE
+    ads::trace_buffer::instance().clear();
+#endif
     stresstest();
     stresstest(&gen);
+    if(!trace_path.empty()) { write_trace(trace_path); }
 
     std::cout << GREEN("\nOK\n");
 }
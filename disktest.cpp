@@ -0,0 +1,359 @@
+// Benchmarks for the disk-resident ADS_disk_set and the write-ahead logged ADS_durable_set.
+//
+// g++ -Wall -Wextra -Werror -O3 -std=c++17 -pedantic-errors disktest.cpp -o disktest
+//
+// Keys are derived from their position in the insert sequence, so no copy of the
+// data set is kept in memory and -n can be chosen larger than the available RAM.
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "ADS_disk_set.h"
+#include "ADS_durable_set.h"
+
+using disk_key = std::uint64_t;
+
+// splitmix64, a bijection, so distinct i yield distinct keys
+disk_key key_at(std::uint64_t i, std::uint64_t seed) {
+    std::uint64_t z = i + seed * 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// Zipfian ranks in [0, n) after Gray et al., "Quickly generating billion-record
+// synthetic databases"; theta close to 1 concentrates the accesses on few ranks.
+class Zipf {
+    size_t n;
+    double theta, alpha, zetan, eta;
+    std::uniform_real_distribution<double> dist;
+public:
+    Zipf(size_t n, double theta): n{n}, theta{theta}, alpha{1 / (1 - theta)}, zetan{zeta(n, theta)} {
+        eta = (1 - std::exp((1 - theta) * std::log(2.0 / n))) / (1 - zeta(2, theta) / zetan);
+    }
+
+    template <typename G>
+    size_t operator()(G &gen) {
+        double u = dist(gen);
+        double uz = u * zetan;
+        if (uz < 1) return 0;
+        if (uz < 1 + std::exp(-theta * std::log(2.0))) return 1;
+        return static_cast<size_t>(n * std::exp(alpha * std::log(eta * u - eta + 1))) % n;
+    }
+
+private:
+    static double zeta(size_t n, double theta) {
+        double sum = 0;
+        for (size_t i = 1; i <= n; ++i) sum += std::exp(-theta * std::log(static_cast<double>(i)));
+        return sum;
+    }
+};
+
+template <typename Set>
+void report(const char *phase, const Set &set, double elapsed, size_t ops) {
+    auto const &io = set.io_counters();
+    std::cerr << "elapsed_" << phase << " = " << elapsed << " ms"
+              << ", page_reads/op = " << static_cast<double>(io.pageReads) / ops
+              << ", page_writes/op = " << static_cast<double>(io.pageWrites) / ops
+              << ", hit_rate = " << io.hit_rate() << '\n';
+}
+
+void do_disktest(const std::string &path, size_t n, size_t m, size_t pool, std::uint64_t seed) {
+    using set_t = ADS_disk_set<disk_key>;
+    std::remove(path.c_str());
+    std::remove((path + ".ovf").c_str());
+
+    set_t a{path, pool};
+    std::cerr << "\n=== disktest n = " << n << ", N = " << set_t::N << " keys/page, data = "
+              << n * sizeof(disk_key) / (1024 * 1024) << " MiB, pool = " << pool << " pages ===\n";
+
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < n; ++i) {
+            if (!a.insert(key_at(i, seed))) {
+                std::cerr << "[disktest] err: duplicate insert reported for index " << i << '\n';
+                std::abort();
+            }
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        report("insert", a, std::chrono::duration<double, std::milli>(end - start).count(), n);
+    }
+    std::cerr << "buckets = " << a.bucket_count() << ", load = "
+              << static_cast<double>(a.size()) / (a.bucket_count() * set_t::N) << '\n';
+
+    a.reset_io_counters();
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < m; ++i) {
+            if (!a.count(key_at((i * 7919) % n, seed))) {
+                std::cerr << "[disktest] err: missing key for index " << (i * 7919) % n << '\n';
+                std::abort();
+            }
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        report("count_hit", a, std::chrono::duration<double, std::milli>(end - start).count(), m);
+    }
+
+    a.reset_io_counters();
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < m; ++i) {
+            if (a.count(key_at(n + i, seed))) {
+                std::cerr << "[disktest] err: found key that was never inserted\n";
+                std::abort();
+            }
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        report("count_miss", a, std::chrono::duration<double, std::milli>(end - start).count(), m);
+    }
+
+    a.reset_io_counters();
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < n; i += 2) {
+            if (!a.erase(key_at(i, seed))) {
+                std::cerr << "[disktest] err: couldn't erase key for index " << i << '\n';
+                std::abort();
+            }
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        report("erase", a, std::chrono::duration<double, std::milli>(end - start).count(), (n + 1) / 2);
+    }
+
+    if (a.size() != n / 2) {
+        std::cerr << "[disktest] err: wrong size, expected " << n / 2 << " but is " << a.size() << '\n';
+        std::abort();
+    }
+}
+
+// Lookups with Zipfian key popularity against a table that is larger than the pool.
+void do_zipftest(const std::string &path, size_t n, size_t m, size_t pool, double theta, std::uint64_t seed) {
+    using set_t = ADS_disk_set<disk_key>;
+    std::remove(path.c_str());
+    std::remove((path + ".ovf").c_str());
+
+    set_t a{path, pool};
+    for (size_t i = 0; i < n; ++i) a.insert(key_at(i, seed));
+    a.flush();
+
+    std::cerr << "\n=== zipftest n = " << n << ", theta = " << theta << ", pool = " << pool
+              << " pages, buckets = " << a.bucket_count() << " ===\n";
+
+    Zipf zipf{n, theta};
+    std::mt19937_64 gen{seed};
+    for (size_t i = 0; i < m / 10; ++i) a.count(key_at(zipf(gen), seed));    // warm up the pool
+
+    a.reset_io_counters();
+    auto start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < m; ++i) {
+        if (!a.count(key_at(zipf(gen), seed))) {
+            std::cerr << "[zipftest] err: missing key\n";
+            std::abort();
+        }
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    double elapsed = std::chrono::duration<double, std::milli>(end - start).count();
+
+    auto const &io = a.io_counters();
+    report("zipf_count", a, elapsed, m);
+    std::cerr << "latency = " << elapsed * 1e6 / m << " ns/lookup, miss_latency = "
+              << (io.misses ? io.missNanos / io.misses : 0) << " ns/miss, evictions = " << io.evictions << '\n';
+}
+
+// Sustained durable insert throughput for group commits of 1, 8, 64, ... records.
+void do_waltest(const std::string &path, size_t n, size_t max_group, std::uint64_t seed) {
+    using set_t = ADS_durable_set<disk_key>;
+    std::cerr << "\n=== waltest n = " << n << " durable inserts per group size ===\n";
+
+    for (size_t group = 1; group <= max_group; group *= 8) {
+        std::remove((path + ".log").c_str());
+        std::remove((path + ".ckpt").c_str());
+
+        double elapsed;
+        {
+            set_t a{path, group, n * 2 / 5};
+            auto start = std::chrono::high_resolution_clock::now();
+            for (size_t i = 0; i < n; ++i) a.insert(key_at(i, seed));
+            a.sync();
+            auto end = std::chrono::high_resolution_clock::now();
+            elapsed = std::chrono::duration<double, std::milli>(end - start).count();
+
+            auto const &log = a.log_counters();
+            std::cerr << "group = " << group << ": elapsed_insert = " << elapsed << " ms, "
+                      << static_cast<size_t>(n / (elapsed / 1000)) << " inserts/s, commits = " << log.commits
+                      << ", checkpoints = " << log.checkpoints << '\n';
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        set_t b{path, group, n * 2 / 5};
+        auto end = std::chrono::high_resolution_clock::now();
+        if (b.size() != n) {
+            std::cerr << "[waltest] err: recovered " << b.size() << " keys instead of " << n << '\n';
+            std::abort();
+        }
+        std::cerr << "           elapsed_recover = " << std::chrono::duration<double, std::milli>(end - start).count()
+                  << " ms, replayed = " << b.log_counters().replayed << " records\n";
+    }
+}
+
+// Recovery from a checkpoint plus a log whose tail was torn by a crash: a record cut
+// short and a complete record with a bad checksum. Every key acknowledged before the
+// crash has to come back with its last state, the torn inserts must not.
+void do_recoverytest(const std::string &path, std::uint64_t seed) {
+    using set_t = ADS_durable_set<disk_key>;
+    std::cerr << "\n=== recoverytest ===\n";
+    std::remove((path + ".log").c_str());
+    std::remove((path + ".ckpt").c_str());
+
+    size_t const n = 10000;
+
+    // before the first checkpoint everything lives in the log created on open
+    {
+        set_t a{path, 8, n};
+        for (size_t i = 0; i < n / 10; ++i) a.insert(key_at(i, seed));
+        a.erase(key_at(0, seed));
+    }
+    {
+        set_t a{path, 8, n};
+        if (a.size() != n / 10 - 1 || a.count(key_at(0, seed)) || !a.count(key_at(n / 10 - 1, seed)) || a.log_counters().checkpoints != 0) {
+            std::cerr << "[recoverytest] err: reopened set before the first checkpoint has " << a.size() << " keys instead of " << n / 10 - 1 << '\n';
+            std::abort();
+        }
+        std::cerr << "recovered " << a.size() << " keys before the first checkpoint, replayed = " << a.log_counters().replayed << " records\n";
+    }
+    std::remove((path + ".log").c_str());
+    std::remove((path + ".ckpt").c_str());
+
+    {
+        set_t a{path, 8, n};                                      // one checkpoint after n records
+        for (size_t i = 0; i < n; ++i) a.insert(key_at(i, seed));
+        for (size_t i = 0; i < n; i += 3) a.erase(key_at(i, seed));
+        for (size_t i = n; i < n + 100; ++i) a.insert(key_at(i, seed));
+        a.sync();
+        if (a.log_counters().checkpoints != 1) {
+            std::cerr << "[recoverytest] err: expected one checkpoint, got " << a.log_counters().checkpoints << '\n';
+            std::abort();
+        }
+    }
+
+    // a second set writes the records a crash would have torn
+    std::string scratch = path + ".scratch";
+    std::remove((scratch + ".log").c_str());
+    std::remove((scratch + ".ckpt").c_str());
+    {
+        set_t t{scratch, 1, 0};
+        t.insert(key_at(n + 100, seed));
+        t.insert(key_at(n + 101, seed));
+    }
+    std::vector<char> torn;
+    {
+        std::FILE *f = std::fopen((scratch + ".log").c_str(), "rb");
+        char chunk[256];
+        for (size_t k; f && (k = std::fread(chunk, 1, sizeof(chunk), f)) > 0; ) torn.insert(torn.end(), chunk, chunk + k);
+        if (f) std::fclose(f);
+    }
+    std::remove((scratch + ".log").c_str());
+    std::remove((scratch + ".ckpt").c_str());
+    size_t const record = torn.size() / 2;
+    torn[record] ^= 0x40;                                         // second record: flipped op bit, checksum mismatch
+    {
+        std::FILE *f = std::fopen((path + ".log").c_str(), "ab");
+        std::fwrite(torn.data() + record, 1, record, f);
+        std::fwrite(torn.data(), 1, record / 2, f);               // first record: cut in half
+        std::fclose(f);
+    }
+
+    auto check = [&path, seed](bool reinserted, const char *when) {
+        set_t b{path, 8, 0};
+        size_t expected = 0;
+        for (size_t i = 0; i < n + 102; ++i) {
+            bool present = (i < n + 100 && (i >= n || i % 3 != 0)) || (reinserted && i == n + 101);
+            expected += present;
+            if (b.count(key_at(i, seed)) != present) {
+                std::cerr << "[recoverytest] err: key " << i << " is" << (present ? " missing" : " present") << ' ' << when << '\n';
+                std::abort();
+            }
+        }
+        if (b.size() != expected) {
+            std::cerr << "[recoverytest] err: recovered " << b.size() << " keys instead of " << expected << ' ' << when << '\n';
+            std::abort();
+        }
+        std::cerr << "recovered " << b.size() << " keys " << when << ", replayed = " << b.log_counters().replayed << " records\n";
+        if (!reinserted) b.insert(key_at(n + 101, seed));
+    };
+
+    // the torn tail is cut off, so a key logged after recovery survives the next one
+    check(false, "after the crash");
+    check(true, "after the next insert");
+}
+
+int main(int argc, char** argv) {
+    size_t n = 1'000'000;
+    size_t m = 100'000;
+    size_t p = 1024;
+    double z = 0;
+    size_t g = 0;
+    std::uint64_t s = 666;
+    std::string path = "/tmp/ads_disk_set.bin";
+
+    int c;
+    while ((c = getopt(argc, argv, "n:m:c:z:g:s:p:h")) != -1) {
+        switch (c) {
+            case 'n':
+                n = std::atoll(optarg);
+                break;
+            case 'm':
+                m = std::atoll(optarg);
+                break;
+            case 'c':
+                p = std::atoll(optarg);
+                break;
+            case 'z':
+                z = std::atof(optarg);
+                break;
+            case 'g':
+                g = std::atoll(optarg);
+                break;
+            case 's':
+                s = std::atoll(optarg);
+                break;
+            case 'p':
+                path = optarg;
+                break;
+            case 'h':
+            default:
+                std::cout << "usage: " << argv[0] << " opts\n"
+                          << "  -n $value ... number of keys to insert, default: 1000000\n"
+                          << "  -m $value ... number of lookups per lookup phase, default: 100000\n"
+                          << "  -c $value ... buffer pool capacity in pages, default: 1024\n"
+                          << "  -z $value ... run the Zipfian lookup benchmark with skew $value (0 < z < 1) instead\n"
+                          << "  -g $value ... check crash recovery, then run the write-ahead log benchmark (-m durable inserts) with group commits up to $value instead\n"
+                          << "  -s $value ... seed for the key sequence, default: 666\n"
+                          << "  -p $path  ... table file (overflow pages go to $path.ovf), default: /tmp/ads_disk_set.bin\n"
+                          << "  -h        ... this message\n\n"
+                          << "choose -n so that n * 8 bytes exceeds the RAM of the machine to benchmark a table larger than memory.\n";
+                std::exit(-1);
+        }
+    }
+
+    if (g > 0) {
+        do_recoverytest(path, s);
+        do_waltest(path, m, g, s);
+        return 0;
+    }
+    if (z > 0) {
+        do_zipftest(path, n, m, p, z, s);
+        return 0;
+    }
+    if (m > n) m = n;
+    do_disktest(path, n, m, p, s);
+}
@@ -15,7 +15,9 @@
  // (2) Der zweite Templateparameter kann mit Compileroption -DSIZE=<n> festgelegt
  //     werden, also zb -DSIZE=13, andernfalls wird der Defaultwert verwendet. Es wird
  //     empfohlen, jedenfalls auch mit -DSIZE=1 zu testen (das macht auch der Unit-Test)
- // (3) Das Testprogramm testet nicht alle ADS_set-Methoden/Funktionen, es kann aber 
+ // (3) Mit -DCONTIGUOUS wird die Ueberlaufpolitik ads::contiguous_overflow getestet
+ //     (ein wachsender Ueberlaufbucket pro Kette statt verketteter Buckets).
+ // (4) Das Testprogramm testet nicht alle ADS_set-Methoden/Funktionen, es kann aber 
  //     entsprechend erweitert werden.
  // 
  // 1. Projektphase:
@@ -69,12 +71,17 @@
  using reference_set = std::set<Key>; 
 
  #ifdef SIZE
-   using ads_set = ADS_set<Key,SIZE>;
+   using ads_set_linked = ADS_set<Key,SIZE>;
  #else
-   using ads_set = ADS_set<Key>;
+   using ads_set_linked = ADS_set<Key>;
+ #endif
+ #ifdef CONTIGUOUS
+   using ads_set = ads_set_linked::with_overflow<ads::contiguous_overflow>;
+ #else
+   using ads_set = ads_set_linked;
  #endif
 
- enum class Code {quit = 0, new_set, delete_set, insert, erase, find, count, size, empty, dump, trace, finsert, ferase, rinsert, rerase, help, clear, iterator, list, iinsert, fiinsert, riinsert};  
+ enum class Code {quit = 0, new_set, delete_set, insert, erase, find, count, size, empty, dump, trace, finsert, ferase, rinsert, rerase, help, clear, iterator, list, iinsert, fiinsert, riinsert, stats};  
 
  struct Command {
    Code code;
@@ -104,6 +111,7 @@
    {Code::iterator, "iterator", "iterator/find test", true, false},
  #endif
    {Code::dump, "dump", "call dump()", true, false},
+   {Code::stats, "stats", "call stats() and print the table statistics", true, false},
    {Code::trace, "trace", "toggle tracing on/off", false, false},
    {Code::list, "list", "list all intended elements (sorted)", true, false},
    {Code::help, "help", "list of commands", false, false},
@@ -379,6 +387,21 @@
          case Code::dump:
            const_c->dump(std::cout);
            break;
+         case Code::stats: {
+           auto st {const_c->stats()};
+           std::cout << "\n size ............. " << st.size
+                     << "\n buckets .......... " << st.bucketCount << " (+ " << st.overflowBuckets << " overflow, " << st.chainLengths[0] << " unallocated)"
+                     << "\n splits ........... " << st.splitCount
+                     << "\n load factor ...... " << st.loadFactor
+                     << "\n max chain ........ " << st.maxChainLength
+                     << "\n chain histogram ..";
+           for (size_t k {1}; k < st.chainLengths.size(); ++k)
+             if (st.chainLengths[k]) std::cout << ' ' << k << ':' << st.chainLengths[k];
+           std::cout << "\n memory ........... " << st.directoryBytes << " B directory, " << st.bucketBytes << " B buckets, "
+                     << st.wastedBytes << " B unused slots"
+                     << "\n bytes/element .... " << st.bytesPerElement;
+           break;
+         }
          case Code::fiinsert: {
            std::string filename;
            line_stream >> filename;